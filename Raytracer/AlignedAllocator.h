@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Allocator for std::vector that aligns storage, e.g. to SIMD register width or cache lines
+template <typename T, size_t Alignment>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() {}
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t count)
+	{
+		// Over allocate, then keep the pointer malloc gave us just in front of the aligned block
+		void* pRaw = malloc(count * sizeof(T) + Alignment + sizeof(void*));
+		if (pRaw == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		uintptr_t aligned = (reinterpret_cast<uintptr_t>(pRaw) + sizeof(void*) + Alignment - 1) & ~(static_cast<uintptr_t>(Alignment) - 1);
+		reinterpret_cast<void**>(aligned)[-1] = pRaw;
+		return reinterpret_cast<T*>(aligned);
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		if (p != nullptr)
+		{
+			free(reinterpret_cast<void**>(p)[-1]);
+		}
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const
+	{
+		return false;
+	}
+};
@@ -0,0 +1,455 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <vector>
+
+#include "HitObjects.h"
+#include "Profiler.h"
+#include "SphereStore.h"
+
+#define RAY_PACKET_SIZE 16 // 4x4 pixels
+
+struct BVHNode
+{
+	AABB m_bounds;
+	int m_leftFirst;	// Index of the left child, or of the first hit object when this is a leaf
+	int m_count;		// Number of hit objects in the leaf, 0 for interior nodes
+
+	bool IsLeaf() const
+	{
+		return m_count > 0;
+	}
+};
+
+// Bounding volume hierarchy over hit objects, built with the surface area heuristic. Leaves are intersected
+// through a SphereStore, so every hit object has to be a Sphere.
+class BVH
+{
+public:
+	BVH() {}
+
+	void Build(const std::vector<HitObject*>& hitObjects)
+	{
+		m_hitObjects = hitObjects;
+		m_nodes.clear();
+
+		if (m_hitObjects.empty())
+		{
+			return;
+		}
+
+		m_bounds.resize(m_hitObjects.size());
+		m_centroids.resize(m_hitObjects.size());
+		for (size_t i = 0; i < m_hitObjects.size(); i++)
+		{
+			m_bounds[i] = m_hitObjects[i]->GetBoundingBox();
+			m_centroids[i] = m_bounds[i].GetCentroid();
+		}
+
+		m_nodes.reserve(m_hitObjects.size() * 2);
+
+		BVHNode root;
+		root.m_leftFirst = 0;
+		root.m_count = static_cast<int>(m_hitObjects.size());
+		m_nodes.push_back(root);
+		UpdateNodeBounds(0);
+		Subdivide(0, 0);
+
+		m_sphereStore.Build(m_hitObjects);
+
+		// Only needed while building
+		m_bounds.clear();
+		m_bounds.shrink_to_fit();
+		m_centroids.clear();
+		m_centroids.shrink_to_fit();
+	}
+
+	// Finds the closest hit object along the ray
+	bool HasHit(const Ray& r, float minHitDistance, float maxHitDistance, HitRecord& rHitRecord) const
+	{
+		if (m_nodes.empty())
+		{
+			return false;
+		}
+
+		const Vec3f origin = r.GetOrigin();
+		const Vec3f direction = r.GetDirection();
+		const Vec3f invDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+		bool hasHit = false;
+		float closestHitDistance = maxHitDistance;
+		int closestObjectId = -1;
+
+		TraversalCounts counts;
+		int stack[s_stackSize];
+		int stackSize = 0;
+
+		if (m_nodes[0].m_bounds.HitDistance(origin, invDirection, minHitDistance, closestHitDistance) == FLT_MAX)
+		{
+			return false;
+		}
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BVHNode& node = m_nodes[stack[--stackSize]];
+			counts.m_nodeVisits++;
+
+			if (node.IsLeaf())
+			{
+				counts.m_sphereTests += node.m_count;
+				if (m_sphereStore.HasHit(node.m_leftFirst, node.m_count, origin, direction, minHitDistance, closestHitDistance, closestObjectId))
+				{
+					hasHit = true;
+				}
+				continue;
+			}
+
+			// Visit the nearest child first so the farther one can be culled by the closest hit
+			int nearChild = node.m_leftFirst;
+			int farChild = node.m_leftFirst + 1;
+			float nearDistance = m_nodes[nearChild].m_bounds.HitDistance(origin, invDirection, minHitDistance, closestHitDistance);
+			float farDistance = m_nodes[farChild].m_bounds.HitDistance(origin, invDirection, minHitDistance, closestHitDistance);
+			if (farDistance < nearDistance)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearDistance, farDistance);
+			}
+
+			if (farDistance != FLT_MAX)
+			{
+				stack[stackSize++] = farChild;
+			}
+			if (nearDistance != FLT_MAX)
+			{
+				stack[stackSize++] = nearChild;
+			}
+		}
+
+		// Only the closest sphere needs a full hit record
+		if (hasHit)
+		{
+			static_cast<Sphere*>(m_hitObjects[closestObjectId])->SetHitRecord(r, closestHitDistance, rHitRecord);
+		}
+
+		return hasHit;
+	}
+
+	// Closest hits of up to RAY_PACKET_SIZE rays that start close together and point the same way, like the camera
+	// rays of neighbouring pixels. The packet walks the tree once, going into a node while any of its rays still
+	// reaches it, so every node and sphere is loaded once for all the rays instead of once per ray. Each ray gets the
+	// same hit HasHit would give it. Returns how many of the rays hit something.
+	int HasHitPacket(const Ray* pRays, int numOfRays, float minHitDistance, float maxHitDistance, HitRecord* pHitRecords, bool* pHasHits) const
+	{
+		assert(numOfRays <= RAY_PACKET_SIZE);
+		for (int i = 0; i < numOfRays; i++)
+		{
+			pHasHits[i] = false;
+		}
+		if (m_nodes.empty())
+		{
+			return 0;
+		}
+
+		Vec3f origins[RAY_PACKET_SIZE];
+		Vec3f directions[RAY_PACKET_SIZE];
+		Vec3f invDirections[RAY_PACKET_SIZE];
+		float closestHitDistances[RAY_PACKET_SIZE];
+		int closestObjectIds[RAY_PACKET_SIZE];
+		for (int i = 0; i < numOfRays; i++)
+		{
+			origins[i] = pRays[i].GetOrigin();
+			directions[i] = pRays[i].GetDirection();
+			invDirections[i] = Vec3f(1.0f / directions[i].x, 1.0f / directions[i].y, 1.0f / directions[i].z);
+			closestHitDistances[i] = maxHitDistance;
+			closestObjectIds[i] = -1;
+		}
+
+		// Each entry also keeps the first ray that reached the parent, as the rays before it can't reach the node
+		TraversalCounts counts;
+		int stack[s_stackSize];
+		int firstRayStack[s_stackSize];
+		int stackSize = 0;
+		stack[stackSize] = 0;
+		firstRayStack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			stackSize--;
+			const BVHNode& node = m_nodes[stack[stackSize]];
+			int firstRay = firstRayStack[stackSize];
+			counts.m_nodeVisits++;
+
+			while (firstRay < numOfRays && node.m_bounds.HitDistance(origins[firstRay], invDirections[firstRay], minHitDistance, closestHitDistances[firstRay]) == FLT_MAX)
+			{
+				firstRay++;
+			}
+			if (firstRay == numOfRays)
+			{
+				continue;
+			}
+
+			if (node.IsLeaf())
+			{
+				for (int i = firstRay; i < numOfRays; i++)
+				{
+					if (i == firstRay || node.m_bounds.HitDistance(origins[i], invDirections[i], minHitDistance, closestHitDistances[i]) != FLT_MAX)
+					{
+						counts.m_sphereTests += node.m_count;
+						m_sphereStore.HasHit(node.m_leftFirst, node.m_count, origins[i], directions[i], minHitDistance, closestHitDistances[i], closestObjectIds[i]);
+					}
+				}
+				continue;
+			}
+
+			// The first ray that reaches the node picks which child is nearer
+			int nearChild = node.m_leftFirst;
+			int farChild = node.m_leftFirst + 1;
+			if (m_nodes[farChild].m_bounds.HitDistance(origins[firstRay], invDirections[firstRay], minHitDistance, closestHitDistances[firstRay]) <
+				m_nodes[nearChild].m_bounds.HitDistance(origins[firstRay], invDirections[firstRay], minHitDistance, closestHitDistances[firstRay]))
+			{
+				std::swap(nearChild, farChild);
+			}
+			stack[stackSize] = farChild;
+			firstRayStack[stackSize++] = firstRay;
+			stack[stackSize] = nearChild;
+			firstRayStack[stackSize++] = firstRay;
+		}
+
+		// Only the closest spheres need full hit records
+		int numOfHits = 0;
+		for (int i = 0; i < numOfRays; i++)
+		{
+			if (closestObjectIds[i] >= 0)
+			{
+				static_cast<Sphere*>(m_hitObjects[closestObjectIds[i]])->SetHitRecord(pRays[i], closestHitDistances[i], pHitRecords[i]);
+				pHasHits[i] = true;
+				numOfHits++;
+			}
+		}
+		return numOfHits;
+	}
+
+	// Any hit query for shadow rays. Stops at the first sphere found between the two distances and never builds a
+	// hit record, so unlike HasHit the order children are visited in doesn't matter.
+	bool IsOccluded(const Ray& r, float minHitDistance, float maxHitDistance) const
+	{
+		if (m_nodes.empty())
+		{
+			return false;
+		}
+
+		const Vec3f origin = r.GetOrigin();
+		const Vec3f direction = r.GetDirection();
+		const Vec3f invDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+		TraversalCounts counts;
+		int stack[s_stackSize];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BVHNode& node = m_nodes[stack[--stackSize]];
+			counts.m_nodeVisits++;
+			if (node.m_bounds.HitDistance(origin, invDirection, minHitDistance, maxHitDistance) == FLT_MAX)
+			{
+				continue;
+			}
+
+			if (node.IsLeaf())
+			{
+				counts.m_sphereTests += node.m_count;
+				if (m_sphereStore.IsOccluded(node.m_leftFirst, node.m_count, origin, direction, minHitDistance, maxHitDistance))
+				{
+					return true;
+				}
+				continue;
+			}
+
+			stack[stackSize++] = node.m_leftFirst + 1;
+			stack[stackSize++] = node.m_leftFirst;
+		}
+
+		return false;
+	}
+
+	int GetNodeCount() const
+	{
+		return static_cast<int>(m_nodes.size());
+	}
+
+	void SetSimdLevel(SimdLevel simdLevel)
+	{
+		m_sphereStore.SetSimdLevel(simdLevel);
+	}
+
+private:
+	static const int s_numOfBins = 16;
+	static const int s_maxLeafSize = 8; // One AVX2 sphere test
+	static const int s_maxDepth = 64; // Deeper nodes stay leaves, however many objects they hold
+
+	// Traversal keeps at most one unvisited sibling per level, plus both children of the node it just opened
+	static const int s_stackSize = s_maxDepth + 1;
+
+	void UpdateNodeBounds(int nodeIndex)
+	{
+		BVHNode& node = m_nodes[nodeIndex];
+		node.m_bounds = AABB();
+		for (int i = node.m_leftFirst; i < node.m_leftFirst + node.m_count; i++)
+		{
+			node.m_bounds.Grow(m_bounds[i]);
+		}
+	}
+
+	// Finds the cheapest split plane using binned SAH, returns the cost of splitting
+	float FindBestSplit(const BVHNode& node, int& rAxis, float& rSplitPosition)
+	{
+		float bestCost = FLT_MAX;
+
+		AABB centroidBounds;
+		for (int i = node.m_leftFirst; i < node.m_leftFirst + node.m_count; i++)
+		{
+			centroidBounds.Grow(m_centroids[i]);
+		}
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float boundsMin = centroidBounds.m_min.v[axis];
+			const float boundsMax = centroidBounds.m_max.v[axis];
+			if (boundsMin == boundsMax)
+			{
+				continue;
+			}
+
+			// Centroids far enough apart overflow the extent, and ones close enough together overflow the scale,
+			// neither can be binned. If no axis can, Subdivide splits down the middle.
+			const float scale = s_numOfBins / (boundsMax - boundsMin);
+			if (!isfinite(boundsMax - boundsMin) || !isfinite(scale))
+			{
+				continue;
+			}
+
+			AABB binBounds[s_numOfBins];
+			int binCount[s_numOfBins] = {};
+			for (int i = node.m_leftFirst; i < node.m_leftFirst + node.m_count; i++)
+			{
+				const int bin = std::max(0, std::min(s_numOfBins - 1, static_cast<int>((m_centroids[i].v[axis] - boundsMin) * scale)));
+				binCount[bin]++;
+				binBounds[bin].Grow(m_bounds[i]);
+			}
+
+			// Sweep from both sides to get the area and count on each side of every plane
+			float leftArea[s_numOfBins - 1];
+			float rightArea[s_numOfBins - 1];
+			int leftCount[s_numOfBins - 1];
+			int rightCount[s_numOfBins - 1];
+			AABB leftBox;
+			AABB rightBox;
+			int leftSum = 0;
+			int rightSum = 0;
+			for (int i = 0; i < s_numOfBins - 1; i++)
+			{
+				leftSum += binCount[i];
+				leftCount[i] = leftSum;
+				leftBox.Grow(binBounds[i]);
+				leftArea[i] = leftBox.GetSurfaceArea();
+
+				rightSum += binCount[s_numOfBins - 1 - i];
+				rightCount[s_numOfBins - 2 - i] = rightSum;
+				rightBox.Grow(binBounds[s_numOfBins - 1 - i]);
+				rightArea[s_numOfBins - 2 - i] = rightBox.GetSurfaceArea();
+			}
+
+			const float binWidth = (boundsMax - boundsMin) / s_numOfBins;
+			for (int i = 0; i < s_numOfBins - 1; i++)
+			{
+				float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+				if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost)
+				{
+					rAxis = axis;
+					rSplitPosition = boundsMin + binWidth * (i + 1);
+					bestCost = cost;
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	void Subdivide(int nodeIndex, int depth)
+	{
+		BVHNode node = m_nodes[nodeIndex];
+		if (node.m_count <= 1 || depth == s_maxDepth)
+		{
+			return;
+		}
+
+		int axis = 0;
+		float splitPosition = 0.0f;
+		const float splitCost = FindBestSplit(node, axis, splitPosition);
+		const float leafCost = node.m_count * node.m_bounds.GetSurfaceArea();
+		if (splitCost >= leafCost && node.m_count <= s_maxLeafSize)
+		{
+			return;
+		}
+
+		int i = node.m_leftFirst;
+		int j = node.m_leftFirst + node.m_count - 1;
+		if (splitCost == FLT_MAX)
+		{
+			// All centroids are in the same spot, or too far apart to bin, so split down the middle
+			i = node.m_leftFirst + node.m_count / 2;
+		}
+		else
+		{
+			while (i <= j)
+			{
+				if (m_centroids[i].v[axis] < splitPosition)
+				{
+					i++;
+				}
+				else
+				{
+					std::swap(m_hitObjects[i], m_hitObjects[j]);
+					std::swap(m_bounds[i], m_bounds[j]);
+					std::swap(m_centroids[i], m_centroids[j]);
+					j--;
+				}
+			}
+		}
+
+		const int leftCount = i - node.m_leftFirst;
+		if (leftCount == 0 || leftCount == node.m_count)
+		{
+			return;
+		}
+
+		const int leftChild = static_cast<int>(m_nodes.size());
+		BVHNode left;
+		left.m_leftFirst = node.m_leftFirst;
+		left.m_count = leftCount;
+		BVHNode right;
+		right.m_leftFirst = i;
+		right.m_count = node.m_count - leftCount;
+		m_nodes.push_back(left);
+		m_nodes.push_back(right);
+
+		m_nodes[nodeIndex].m_leftFirst = leftChild;
+		m_nodes[nodeIndex].m_count = 0;
+
+		UpdateNodeBounds(leftChild);
+		UpdateNodeBounds(leftChild + 1);
+		Subdivide(leftChild, depth + 1);
+		Subdivide(leftChild + 1, depth + 1);
+	}
+
+	std::vector<BVHNode> m_nodes;
+	std::vector<HitObject*> m_hitObjects; // Reordered so every leaf references a contiguous range
+	SphereStore m_sphereStore;
+
+	// Build data
+	std::vector<AABB> m_bounds;
+	std::vector<Vec3f> m_centroids;
+};
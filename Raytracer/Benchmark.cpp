@@ -0,0 +1,687 @@
+#include <chrono>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Scene.h"
+#include "BVH.h"
+#include "FastMath.h"
+#include "Sampling.h"
+#include "Vec3fSSE.h"
+
+// Keeps a function a real call, the way every vector operation was while they were defined in MathClass.cpp
+#if defined(_MSC_VER)
+#define BENCHMARK_NOINLINE __declspec(noinline)
+#else
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+
+static bool HasHitLinear(const std::vector<HitObject*>& hitObjects, const Ray& r, float minHitDistance, float maxHitDistance, HitRecord& rHitRecord)
+{
+	bool hasHit = false;
+	float closestHitDistance = maxHitDistance;
+	for (HitObject* pHitObject : hitObjects)
+	{
+		if (pHitObject->HasHit(r, minHitDistance, closestHitDistance, rHitRecord))
+		{
+			hasHit = true;
+		}
+	}
+	return hasHit;
+}
+
+// Scatters small spheres over a square patch of ground that grows with the sphere count, so density stays the same
+static void MakeSphereField(int numOfSpheres, Scene& rScene)
+{
+	const float fieldSize = sqrtf(static_cast<float>(numOfSpheres)) * 1.5f;
+	rScene.Reserve(numOfSpheres, 0, 1, 0, 0);
+	const uint32_t materialIndex = rScene.AddLambertianDiffuse(Vec3f(0.5f, 0.5f, 0.5f));
+	for (int i = 0; i < numOfSpheres; i++)
+	{
+		float radius = GetRandomNum() * 0.2f + 0.2f;
+		Vec3f center((GetRandomNum() - 0.5f) * fieldSize, radius + GetRandomNum() * 2.0f, (GetRandomNum() - 0.5f) * fieldSize);
+		rScene.AddSphere(center, radius, materialIndex);
+	}
+}
+
+static void MakeRays(int numOfRays, float fieldSize, std::vector<Ray>& rRays)
+{
+	Random random(4321);
+	rRays.reserve(numOfRays);
+	for (int i = 0; i < numOfRays; i++)
+	{
+		Vec3f origin((GetRandomNum() - 0.5f) * fieldSize, 1.0f + GetRandomNum() * 2.0f, (GetRandomNum() - 0.5f) * fieldSize);
+		Vec3f direction = (GetRandomUnitVecInSphere(random) + Vec3f(0.0f, -0.2f, 0.0f)).normalize();
+		rRays.push_back(Ray(origin, direction));
+	}
+}
+
+template <typename HasHitFunction>
+static double MeasureRaysPerSecond(const std::vector<Ray>& rays, int numOfRays, HasHitFunction hasHit, int& rNumOfHits)
+{
+	rNumOfHits = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numOfRays; i++)
+	{
+		HitRecord hitRecord;
+		if (hasHit(rays[i], hitRecord))
+		{
+			rNumOfHits++;
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+	return numOfRays / seconds;
+}
+
+void RunBVHBenchmark()
+{
+	const int sceneSizes[] = { 100, 10000, 1000000 };
+	const int numOfRays = 200000;
+
+	srand(1234);
+
+	const char* simdLevelNames[] = { "scalar", "sse", "avx2" };
+	const SimdLevel supportedSimdLevel = GetSupportedSimdLevel();
+
+	std::cout << "spheres, linear rays/s, bvh rays/s, speedup, bvh build ms, bvh occluded rays/s";
+	for (int level = enScalar; level <= supportedSimdLevel; level++)
+	{
+		std::cout << ", bvh " << simdLevelNames[level] << " rays/s";
+	}
+	std::cout << std::endl;
+
+	for (int numOfSpheres : sceneSizes)
+	{
+		Scene scene;
+		MakeSphereField(numOfSpheres, scene);
+		const std::vector<HitObject*>& hitObjects = scene.m_hitObjects;
+
+		std::vector<Ray> rays;
+		MakeRays(numOfRays, sqrtf(static_cast<float>(numOfSpheres)) * 1.5f, rays);
+
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		BVH bvh;
+		bvh.Build(hitObjects);
+		auto buildEnd = std::chrono::high_resolution_clock::now();
+		double buildMs = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+		// The linear scan gets far fewer rays on big scenes so the benchmark finishes in reasonable time
+		const int numOfLinearRays = std::max(100, std::min(numOfRays, 200000000 / numOfSpheres));
+
+		int linearHits = 0;
+		double linearRaysPerSecond = MeasureRaysPerSecond(rays, numOfLinearRays,
+			[&](const Ray& r, HitRecord& rHitRecord) { return HasHitLinear(hitObjects, r, 0.001f, FLT_MAX, rHitRecord); }, linearHits);
+
+		int bvhHits = 0;
+		double bvhRaysPerSecond = MeasureRaysPerSecond(rays, numOfRays,
+			[&](const Ray& r, HitRecord& rHitRecord) { return bvh.HasHit(r, 0.001f, FLT_MAX, rHitRecord); }, bvhHits);
+
+		// Both paths have to agree on the rays they share
+		int bvhHitsOnLinearRays = 0;
+		MeasureRaysPerSecond(rays, numOfLinearRays,
+			[&](const Ray& r, HitRecord& rHitRecord) { return bvh.HasHit(r, 0.001f, FLT_MAX, rHitRecord); }, bvhHitsOnLinearRays);
+		if (bvhHitsOnLinearRays != linearHits)
+		{
+			std::cout << "Mismatch: linear hit " << linearHits << " rays, bvh hit " << bvhHitsOnLinearRays << std::endl;
+		}
+
+		// Any hit query, which has to find a hit on exactly the rays the closest hit query does
+		int occludedHits = 0;
+		double occludedRaysPerSecond = MeasureRaysPerSecond(rays, numOfRays,
+			[&](const Ray& r, HitRecord&) { return bvh.IsOccluded(r, 0.001f, FLT_MAX); }, occludedHits);
+		if (occludedHits != bvhHits)
+		{
+			std::cout << "Mismatch: bvh hit " << bvhHits << " rays, occlusion query hit " << occludedHits << std::endl;
+		}
+
+		std::cout << numOfSpheres << ", " << linearRaysPerSecond << ", " << bvhRaysPerSecond << ", " << bvhRaysPerSecond / linearRaysPerSecond << ", " << buildMs << ", " << occludedRaysPerSecond;
+
+		// Same BVH with each sphere kernel forced
+		for (int level = enScalar; level <= supportedSimdLevel; level++)
+		{
+			bvh.SetSimdLevel(static_cast<SimdLevel>(level));
+			int simdHits = 0;
+			double simdRaysPerSecond = MeasureRaysPerSecond(rays, numOfRays,
+				[&](const Ray& r, HitRecord& rHitRecord) { return bvh.HasHit(r, 0.001f, FLT_MAX, rHitRecord); }, simdHits);
+			std::cout << ", " << simdRaysPerSecond;
+		}
+		std::cout << std::endl;
+	}
+}
+
+// The old way: every argument copied and the function out of line
+BENCHMARK_NOINLINE static bool HitSphereByValue(Ray r, Vec3f center, float radius, float minHitDistance, float& rMaxHitDistance)
+{
+	Vec3f oc = r.GetOrigin() - center;
+	float a = r.GetDirection().dot(r.GetDirection());
+	float b = oc.dot(r.GetDirection());
+	float c = oc.dot(oc) - radius * radius;
+	float discriminant = b * b - a * c;
+	if (discriminant > 0.0f)
+	{
+		float t = (-b - sqrtf(discriminant)) / a;
+		if (t < rMaxHitDistance && t > minHitDistance)
+		{
+			rMaxHitDistance = t;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool HitSphere(const Ray& r, const Vec3f& center, float radius, float minHitDistance, float& rMaxHitDistance)
+{
+	const Vec3f oc = r.GetOrigin() - center;
+	const float a = r.GetDirection().dot(r.GetDirection());
+	const float b = oc.dot(r.GetDirection());
+	const float c = oc.dot(oc) - radius * radius;
+	const float discriminant = b * b - a * c;
+	if (discriminant > 0.0f)
+	{
+		const float t = (-b - sqrtf(discriminant)) / a;
+		if (t < rMaxHitDistance && t > minHitDistance)
+		{
+			rMaxHitDistance = t;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Diffuse and specular light from one light, the same sums CalcLighting does
+BENCHMARK_NOINLINE static Vec3f ShadeByValue(Vec3f point, Vec3f normal, Vec3f lightPosition, Vec3f cameraPosition, Vec3f lightColour, float shininess)
+{
+	Vec3f lightDir = (lightPosition - point).normalize();
+	float diffuse = std::max(0.0f, normal.dot(lightDir));
+	Vec3f v = (cameraPosition - point).normalize();
+	Vec3f h = (lightDir + v).normalize();
+	float specular = std::max(0.0f, powf(normal.dot(h), shininess));
+	return lightColour * (diffuse + specular);
+}
+
+static Vec3f Shade(const Vec3f& point, const Vec3f& normal, const Vec3f& lightPosition, const Vec3f& cameraPosition, const Vec3f& lightColour, float shininess)
+{
+	const Vec3f lightDir = (lightPosition - point).normalize();
+	const float diffuse = std::max(0.0f, normal.dot(lightDir));
+	const Vec3f v = (cameraPosition - point).normalize();
+	const Vec3f h = (lightDir + v).normalize();
+	const float specular = std::max(0.0f, powf(normal.dot(h), shininess));
+	return lightColour * (diffuse + specular);
+}
+
+#if defined(SIMD_X86)
+static bool HitSphereSSE(const Vec3fSSE& origin, const Vec3fSSE& direction, const Vec3fSSE& center, float radius, float minHitDistance, float& rMaxHitDistance)
+{
+	const Vec3fSSE oc = origin - center;
+	const float a = direction.dot(direction);
+	const float b = oc.dot(direction);
+	const float c = oc.dot(oc) - radius * radius;
+	const float discriminant = b * b - a * c;
+	if (discriminant > 0.0f)
+	{
+		const float t = (-b - sqrtf(discriminant)) / a;
+		if (t < rMaxHitDistance && t > minHitDistance)
+		{
+			rMaxHitDistance = t;
+			return true;
+		}
+	}
+	return false;
+}
+
+static Vec3fSSE ShadeSSE(const Vec3fSSE& point, const Vec3fSSE& normal, const Vec3fSSE& lightPosition, const Vec3fSSE& cameraPosition, const Vec3fSSE& lightColour, float shininess)
+{
+	const Vec3fSSE lightDir = (lightPosition - point).normalize();
+	const float diffuse = std::max(0.0f, normal.dot(lightDir));
+	const Vec3fSSE v = (cameraPosition - point).normalize();
+	const Vec3fSSE h = (lightDir + v).normalize();
+	const float specular = std::max(0.0f, powf(normal.dot(h), shininess));
+	return lightColour * (diffuse + specular);
+}
+#endif
+
+// Best time of a few runs of loop(), in nanoseconds per item
+template <typename Loop>
+static double MeasureNanosecondsPerItem(int numOfItems, Loop loop)
+{
+	double bestSeconds = 0.0;
+	for (int run = 0; run < 5; run++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		loop();
+		auto end = std::chrono::high_resolution_clock::now();
+		const double seconds = std::chrono::duration<double>(end - start).count();
+		bestSeconds = (run == 0) ? seconds : std::min(bestSeconds, seconds);
+	}
+	return bestSeconds * 1e9 / numOfItems;
+}
+
+void RunVectorBenchmark()
+{
+	const int numOfRays = 4096;
+	const int numOfSpheres = 256;
+	const int numOfShadePoints = 1 << 18;
+
+	Random random(1234);
+	std::vector<Ray> rays;
+	MakeRays(numOfRays, 20.0f, rays);
+	std::vector<Vec3f> centers;
+	std::vector<float> radii;
+	for (int i = 0; i < numOfSpheres; i++)
+	{
+		centers.push_back(Vec3f((random.NextFloat() - 0.5f) * 20.0f, random.NextFloat() * 2.0f, (random.NextFloat() - 0.5f) * 20.0f));
+		radii.push_back(0.2f + random.NextFloat() * 0.3f);
+	}
+
+	std::vector<Vec3f> points;
+	std::vector<Vec3f> normals;
+	for (int i = 0; i < numOfShadePoints; i++)
+	{
+		points.push_back(Vec3f((random.NextFloat() - 0.5f) * 20.0f, random.NextFloat() * 2.0f, (random.NextFloat() - 0.5f) * 20.0f));
+		normals.push_back(GetRandomUnitVecInSphere(random).normalize());
+	}
+	const Vec3f lightPosition(0.0f, 1.65f, 0.0f);
+	const Vec3f cameraPosition(13.0f, 2.0f, 3.0f);
+	const Vec3f lightColour(0.969f, 0.906f, 0.039f);
+	const float shininess = 5.0f;
+
+	// Every version has to find the same hits and the same light
+	int numOfHits = 0;
+	float hitDistanceSum = 0.0f;
+	Vec3f shadeSum;
+
+	std::cout << "loop, version, ns per item, hits or light sum" << std::endl;
+
+	const int numOfTests = numOfRays * numOfSpheres;
+	double nanoseconds = MeasureNanosecondsPerItem(numOfTests, [&]()
+	{
+		numOfHits = 0;
+		hitDistanceSum = 0.0f;
+		for (const Ray& r : rays)
+		{
+			float closestHitDistance = FLT_MAX;
+			bool hasHit = false;
+			for (int i = 0; i < numOfSpheres; i++)
+			{
+				hasHit |= HitSphereByValue(r, centers[i], radii[i], 0.001f, closestHitDistance);
+			}
+			numOfHits += hasHit ? 1 : 0;
+			hitDistanceSum += hasHit ? closestHitDistance : 0.0f;
+		}
+	});
+	std::cout << "intersect, Vec3f by value out of line, " << nanoseconds << ", " << numOfHits << " " << hitDistanceSum << std::endl;
+
+	nanoseconds = MeasureNanosecondsPerItem(numOfTests, [&]()
+	{
+		numOfHits = 0;
+		hitDistanceSum = 0.0f;
+		for (const Ray& r : rays)
+		{
+			float closestHitDistance = FLT_MAX;
+			bool hasHit = false;
+			for (int i = 0; i < numOfSpheres; i++)
+			{
+				hasHit |= HitSphere(r, centers[i], radii[i], 0.001f, closestHitDistance);
+			}
+			numOfHits += hasHit ? 1 : 0;
+			hitDistanceSum += hasHit ? closestHitDistance : 0.0f;
+		}
+	});
+	std::cout << "intersect, Vec3f, " << nanoseconds << ", " << numOfHits << " " << hitDistanceSum << std::endl;
+
+#if defined(SIMD_X86)
+	std::vector<Vec3fSSE> centersSSE;
+	for (const Vec3f& center : centers)
+	{
+		centersSSE.push_back(Vec3fSSE(center));
+	}
+	nanoseconds = MeasureNanosecondsPerItem(numOfTests, [&]()
+	{
+		numOfHits = 0;
+		hitDistanceSum = 0.0f;
+		for (const Ray& r : rays)
+		{
+			const Vec3fSSE origin(r.GetOrigin());
+			const Vec3fSSE direction(r.GetDirection());
+			float closestHitDistance = FLT_MAX;
+			bool hasHit = false;
+			for (int i = 0; i < numOfSpheres; i++)
+			{
+				hasHit |= HitSphereSSE(origin, direction, centersSSE[i], radii[i], 0.001f, closestHitDistance);
+			}
+			numOfHits += hasHit ? 1 : 0;
+			hitDistanceSum += hasHit ? closestHitDistance : 0.0f;
+		}
+	});
+	std::cout << "intersect, Vec3fSSE, " << nanoseconds << ", " << numOfHits << " " << hitDistanceSum << std::endl;
+#endif
+
+	nanoseconds = MeasureNanosecondsPerItem(numOfShadePoints, [&]()
+	{
+		shadeSum = Vec3f();
+		for (int i = 0; i < numOfShadePoints; i++)
+		{
+			shadeSum += ShadeByValue(points[i], normals[i], lightPosition, cameraPosition, lightColour, shininess);
+		}
+	});
+	std::cout << "shade, Vec3f by value out of line, " << nanoseconds << ", " << shadeSum.r + shadeSum.g + shadeSum.b << std::endl;
+
+	nanoseconds = MeasureNanosecondsPerItem(numOfShadePoints, [&]()
+	{
+		shadeSum = Vec3f();
+		for (int i = 0; i < numOfShadePoints; i++)
+		{
+			shadeSum += Shade(points[i], normals[i], lightPosition, cameraPosition, lightColour, shininess);
+		}
+	});
+	std::cout << "shade, Vec3f, " << nanoseconds << ", " << shadeSum.r + shadeSum.g + shadeSum.b << std::endl;
+
+#if defined(SIMD_X86)
+	const Vec3fSSE lightPositionSSE(lightPosition);
+	const Vec3fSSE cameraPositionSSE(cameraPosition);
+	const Vec3fSSE lightColourSSE(lightColour);
+	std::vector<Vec3fSSE> pointsSSE;
+	std::vector<Vec3fSSE> normalsSSE;
+	for (int i = 0; i < numOfShadePoints; i++)
+	{
+		pointsSSE.push_back(Vec3fSSE(points[i]));
+		normalsSSE.push_back(Vec3fSSE(normals[i]));
+	}
+	nanoseconds = MeasureNanosecondsPerItem(numOfShadePoints, [&]()
+	{
+		Vec3fSSE sum;
+		for (int i = 0; i < numOfShadePoints; i++)
+		{
+			sum += ShadeSSE(pointsSSE[i], normalsSSE[i], lightPositionSSE, cameraPositionSSE, lightColourSSE, shininess);
+		}
+		shadeSum = sum.ToVec3f();
+	});
+	std::cout << "shade, Vec3fSSE, " << nanoseconds << ", " << shadeSum.r + shadeSum.g + shadeSum.b << std::endl;
+#endif
+}
+
+// Prints the worst error found and whether it is within the bound
+static bool ReportError(const char* name, double maxError, double bound)
+{
+	const bool isWithinBound = maxError <= bound;
+	std::cout << name << ", " << maxError << ", " << bound << ", " << (isWithinBound ? "ok" : "FAILED") << std::endl;
+	return isWithinBound;
+}
+
+bool RunFastMathCheck()
+{
+	bool isPassing = true;
+	std::cout << "function, max error, bound, result" << std::endl;
+
+	// Relative error of 1 / sqrt over 40 orders of magnitude
+	double maxRsqrtError = 0.0;
+	double maxRsqrt4Error = 0.0;
+	for (double exponent = -20.0; exponent < 20.0; exponent += 1e-5)
+	{
+		const float x = static_cast<float>(pow(10.0, exponent));
+		const double exact = 1.0 / sqrt(static_cast<double>(x));
+		maxRsqrtError = std::max(maxRsqrtError, fabs(FastRsqrt(x) - exact) / exact);
+#if defined(SIMD_X86)
+		maxRsqrt4Error = std::max(maxRsqrt4Error, fabs(_mm_cvtss_f32(FastRsqrt(_mm_set1_ps(x))) - exact) / exact);
+#endif
+	}
+#if defined(SIMD_X86)
+	isPassing &= ReportError("FastRsqrt", maxRsqrtError, 5e-7);
+	isPassing &= ReportError("FastRsqrt x4", maxRsqrt4Error, 5e-7);
+#else
+	isPassing &= ReportError("FastRsqrt", maxRsqrtError, 5e-6);
+#endif
+
+	// Length of normalized vectors of all sizes, and the direction of the light and half vectors
+	Random random(1234);
+	double maxLengthError = 0.0;
+	double maxLightDirError = 0.0;
+	double maxHalfVectorError = 0.0;
+	for (int i = 0; i < 1000000; i++)
+	{
+		const float scale = powf(10.0f, random.NextFloat() * 6.0f - 3.0f);
+		const Vec3f v = GetRandomUnitVecInSphere(random) * scale;
+		maxLengthError = std::max(maxLengthError, fabs(static_cast<double>(FastNormalize(v).magnitude()) - 1.0));
+
+		const Vec3f point = GetRandomUnitVecInSphere(random) * 10.0f;
+		const Vec3f lightPosition = GetRandomUnitVecInSphere(random) * 10.0f;
+		const Vec3f eyePosition = GetRandomUnitVecInSphere(random) * 10.0f;
+		Vec3f lightDir;
+		Vec3f halfVector;
+		GetLightAndHalfVectors(point, lightPosition, eyePosition, lightDir, halfVector);
+		const Vec3f exactLightDir = (lightPosition - point).normalize();
+		const Vec3f exactHalfVector = (exactLightDir + (eyePosition - point).normalize()).normalize();
+		maxLightDirError = std::max(maxLightDirError, static_cast<double>((lightDir - exactLightDir).magnitude()));
+
+		// With the light straight behind the point from the eye the half vector is the normalized sum of two nearly
+		// opposite vectors, which no version gets accurately, so those are left out
+		if ((exactLightDir + (eyePosition - point).normalize()).magnitude() > 0.1f)
+		{
+			maxHalfVectorError = std::max(maxHalfVectorError, static_cast<double>((halfVector - exactHalfVector).magnitude()));
+		}
+	}
+	isPassing &= ReportError("FastNormalize length", maxLengthError, 1e-6);
+	isPassing &= ReportError("GetLightAndHalfVectors light direction", maxLightDirError, 1e-6);
+	isPassing &= ReportError("GetLightAndHalfVectors half vector", maxHalfVectorError, 1e-5);
+
+	// Whole number powers of the cosines shading raises to the shininess, in ulps of the exact result per unit of
+	// exponent, as every squaring doubles the error carried into it
+	double maxPowUlps = 0.0;
+	double maxPowfUlps = 0.0;
+	for (int exponent = 0; exponent <= FAST_POW_MAX_EXPONENT; exponent++)
+	{
+		for (int i = 0; i < 100000; i++)
+		{
+			const float x = static_cast<float>(i) / 100000.0f * 2.0f - 1.0f;
+			const double exact = pow(static_cast<double>(x), exponent);
+			if (exact == 0.0 || fabs(exact) < FLT_MIN)
+			{
+				continue;
+			}
+			const double ulp = ldexp(1.0, ilogb(exact) - 23);
+			maxPowUlps = std::max(maxPowUlps, fabs(FastPow(x, static_cast<float>(exponent)) - exact) / ulp / std::max(1, exponent));
+			maxPowfUlps = std::max(maxPowfUlps, fabs(powf(x, static_cast<float>(exponent)) - exact) / ulp);
+		}
+	}
+	isPassing &= ReportError("FastPow ulps per unit of exponent", maxPowUlps, 1.0);
+	std::cout << "powf ulps for comparison, " << maxPowfUlps << std::endl;
+
+	// Cost per call, summed so the loops can't be thrown away
+	const int numOfCalls = 1 << 22;
+	std::vector<float> inputs(numOfCalls);
+	for (float& rInput : inputs)
+	{
+		rInput = 0.001f + random.NextFloat();
+	}
+	float sum = 0.0f;
+	std::cout << "function, ns per call" << std::endl;
+	std::cout << "1 / sqrtf, " << MeasureNanosecondsPerItem(numOfCalls, [&]() { for (float x : inputs) { sum += 1.0f / sqrtf(x); } }) << std::endl;
+	std::cout << "FastRsqrt, " << MeasureNanosecondsPerItem(numOfCalls, [&]() { for (float x : inputs) { sum += FastRsqrt(x); } }) << std::endl;
+	std::cout << "powf(x, 5), " << MeasureNanosecondsPerItem(numOfCalls, [&]() { for (float x : inputs) { sum += powf(x, 5.0f); } }) << std::endl;
+	std::cout << "FastPow(x, 5), " << MeasureNanosecondsPerItem(numOfCalls, [&]() { for (float x : inputs) { sum += FastPow(x, 5.0f); } }) << std::endl;
+	if (sum == 0.0f)
+	{
+		std::cout << std::endl;
+	}
+
+	return isPassing;
+}
+
+// The rejection samplers Sampling.h replaced, kept to measure against
+static Vec3f GetRejectionUnitVecInSphere(Random& rRandom)
+{
+	Vec3f p;
+	do
+	{
+		p = Vec3f(rRandom.NextFloat(), rRandom.NextFloat(), rRandom.NextFloat()) * 2.0f - Vec3f(1, 1, 1);
+	} while (p.x * p.x + p.y * p.y + p.z * p.z >= 1.0f);
+	return p;
+}
+
+static Vec3f GetRejectionPointInUnitDisk(Random& rRandom)
+{
+	Vec3f p;
+	do
+	{
+		p = Vec3f(rRandom.NextFloat(), rRandom.NextFloat(), 0.0f) * 2.0f - Vec3f(1.0f, 1.0f, 0.0f);
+	} while (p.dot(p) >= 1.0f);
+	return p;
+}
+
+bool RunSamplingBenchmark()
+{
+	bool isPassing = true;
+	std::cout << "check, max error, bound, result" << std::endl;
+
+	double maxCubeRootError = 0.0;
+	for (double exponent = -30.0; exponent < 0.0; exponent += 1e-5)
+	{
+		const float x = static_cast<float>(pow(10.0, exponent));
+		const double exact = cbrt(static_cast<double>(x));
+		maxCubeRootError = std::max(maxCubeRootError, fabs(CubeRoot(x) - exact) / exact);
+	}
+	isPassing &= ReportError("CubeRoot relative", maxCubeRootError, 5e-7);
+
+	double maxSinCosError = 0.0;
+	for (int i = -1000000; i <= 1000000; i++)
+	{
+		const float x = static_cast<float>(i) / 1000000.0f * (PI / 4.0f);
+		float sine;
+		float cosine;
+		SinCosQuarterPi(x, sine, cosine);
+		maxSinCosError = std::max(maxSinCosError, std::max(fabs(sine - sin(static_cast<double>(x))), fabs(cosine - cos(static_cast<double>(x)))));
+	}
+	isPassing &= ReportError("SinCosQuarterPi", maxSinCosError, 2e-7);
+
+	// Moments of each distribution over a million samples, which are off by a few times 1e-4 from sampling noise
+	// alone, and the 8 wide versions against the single sample ones
+	const int numOfSamples = 1 << 20;
+	Random random(1234);
+	std::vector<float> us(numOfSamples);
+	std::vector<float> vs(numOfSamples);
+	std::vector<float> ws(numOfSamples);
+	std::vector<Vec3f> normals(numOfSamples);
+	for (int i = 0; i < numOfSamples; i++)
+	{
+		us[i] = random.NextFloat();
+		vs[i] = random.NextFloat();
+		ws[i] = random.NextFloat();
+		// Every 16th normal is straight up or down, the frame's special cases
+		normals[i] = (i % 16 == 0) ? Vec3f(0.0f, 0.0f, (i % 32 == 0) ? 1.0f : -1.0f) : GetRandomUnitVecInSphere(random).normalize();
+	}
+
+	Vec3f diskSum;
+	Vec3f ballSum;
+	double diskRadiusSquaredSum = 0.0;
+	double ballRadiusSquaredSum = 0.0;
+	double cosineSum = 0.0;
+	double maxOutside = 0.0;
+	double maxDirectionLengthError = 0.0;
+	double max8WideDifference = 0.0;
+	for (int i = 0; i < numOfSamples; i += 8)
+	{
+		float normalX[8];
+		float normalY[8];
+		float normalZ[8];
+		for (int lane = 0; lane < 8; lane++)
+		{
+			normalX[lane] = normals[i + lane].x;
+			normalY[lane] = normals[i + lane].y;
+			normalZ[lane] = normals[i + lane].z;
+		}
+		float diskX[8];
+		float diskY[8];
+		float ballX[8];
+		float ballY[8];
+		float ballZ[8];
+		float directionX[8];
+		float directionY[8];
+		float directionZ[8];
+		SampleConcentricDisk8(&us[i], &vs[i], diskX, diskY);
+		SampleUnitBall8(&us[i], &vs[i], &ws[i], ballX, ballY, ballZ);
+		SampleCosineHemisphere8(&us[i], &vs[i], normalX, normalY, normalZ, directionX, directionY, directionZ);
+
+		for (int lane = 0; lane < 8; lane++)
+		{
+			float x;
+			float y;
+			SampleConcentricDisk(us[i + lane], vs[i + lane], x, y);
+			const Vec3f disk(x, y, 0.0f);
+			const Vec3f ball = SampleUnitBall(us[i + lane], vs[i + lane], ws[i + lane]);
+			const Vec3f direction = SampleCosineHemisphere(us[i + lane], vs[i + lane], normals[i + lane]);
+
+			diskSum += disk;
+			ballSum += ball;
+			diskRadiusSquaredSum += disk.dot(disk);
+			ballRadiusSquaredSum += ball.dot(ball);
+			cosineSum += direction.dot(normals[i + lane]);
+			maxOutside = std::max(maxOutside, static_cast<double>(std::max(disk.magnitude(), ball.magnitude())) - 1.0);
+			maxOutside = std::max(maxOutside, static_cast<double>(-direction.dot(normals[i + lane])));
+			maxDirectionLengthError = std::max(maxDirectionLengthError, fabs(direction.magnitude() - 1.0));
+
+			max8WideDifference = std::max(max8WideDifference, static_cast<double>((Vec3f(diskX[lane], diskY[lane], 0.0f) - disk).magnitude()));
+			max8WideDifference = std::max(max8WideDifference, static_cast<double>((Vec3f(ballX[lane], ballY[lane], ballZ[lane]) - ball).magnitude()));
+			max8WideDifference = std::max(max8WideDifference, static_cast<double>((Vec3f(directionX[lane], directionY[lane], directionZ[lane]) - direction).magnitude()));
+		}
+	}
+	const double meanBound = 2e-3;
+	isPassing &= ReportError("Disk mean radius squared against 1/2", fabs(diskRadiusSquaredSum / numOfSamples - 0.5), meanBound);
+	isPassing &= ReportError("Disk centroid", (diskSum * (1.0f / numOfSamples)).magnitude(), meanBound);
+	isPassing &= ReportError("Ball mean radius squared against 3/5", fabs(ballRadiusSquaredSum / numOfSamples - 0.6), meanBound);
+	isPassing &= ReportError("Ball centroid", (ballSum * (1.0f / numOfSamples)).magnitude(), meanBound);
+	isPassing &= ReportError("Hemisphere mean cosine against 2/3", fabs(cosineSum / numOfSamples - 2.0 / 3.0), meanBound);
+	isPassing &= ReportError("Hemisphere direction length", maxDirectionLengthError, 1e-5);
+	isPassing &= ReportError("Furthest outside the disk, ball or hemisphere", std::max(0.0, maxOutside), 1e-6);
+	isPassing &= ReportError("8 wide against single", max8WideDifference, 1e-6);
+
+	// Cost per sample, with the random numbers drawn as part of it for the samplers that take a variable number
+	Vec3f sum;
+	std::cout << "sampler, ns per sample" << std::endl;
+	std::cout << "Ball by rejection, " << MeasureNanosecondsPerItem(numOfSamples, [&]() { for (int i = 0; i < numOfSamples; i++) { sum += GetRejectionUnitVecInSphere(random); } }) << std::endl;
+	std::cout << "Ball closed form, " << MeasureNanosecondsPerItem(numOfSamples, [&]() { for (int i = 0; i < numOfSamples; i++) { sum += GetRandomUnitVecInSphere(random); } }) << std::endl;
+	std::cout << "Disk by rejection, " << MeasureNanosecondsPerItem(numOfSamples, [&]() { for (int i = 0; i < numOfSamples; i++) { sum += GetRejectionPointInUnitDisk(random); } }) << std::endl;
+	std::cout << "Disk concentric, " << MeasureNanosecondsPerItem(numOfSamples, [&]()
+	{
+		for (int i = 0; i < numOfSamples; i++)
+		{
+			const float u = random.NextFloat();
+			const float v = random.NextFloat();
+			float x;
+			float y;
+			SampleConcentricDisk(u, v, x, y);
+			sum += Vec3f(x, y, 0.0f);
+		}
+	}) << std::endl;
+
+	// From numbers already drawn, as a packet would be
+	float outX[8];
+	float outY[8];
+	float outZ[8];
+	std::cout << "Ball from numbers, " << MeasureNanosecondsPerItem(numOfSamples, [&]() { for (int i = 0; i < numOfSamples; i++) { sum += SampleUnitBall(us[i], vs[i], ws[i]); } }) << std::endl;
+	std::cout << "Ball from numbers x8, " << MeasureNanosecondsPerItem(numOfSamples, [&]()
+	{
+		for (int i = 0; i < numOfSamples; i += 8)
+		{
+			SampleUnitBall8(&us[i], &vs[i], &ws[i], outX, outY, outZ);
+			sum += Vec3f(outX[0], outY[0], outZ[0]);
+		}
+	}) << std::endl;
+	std::cout << "Cosine hemisphere from numbers, " << MeasureNanosecondsPerItem(numOfSamples, [&]() { for (int i = 0; i < numOfSamples; i++) { sum += SampleCosineHemisphere(us[i], vs[i], normals[i]); } }) << std::endl;
+	std::cout << "Cosine hemisphere from numbers x8, " << MeasureNanosecondsPerItem(numOfSamples, [&]()
+	{
+		float normalX[8] = { 0.0f, 0.6f, 0.0f, 0.0f, -0.8f, 0.0f, 0.6f, 0.0f };
+		float normalY[8] = { 1.0f, 0.8f, 0.0f, 0.6f, 0.6f, 0.0f, 0.0f, -1.0f };
+		float normalZ[8] = { 0.0f, 0.0f, 1.0f, 0.8f, 0.0f, -1.0f, 0.8f, 0.0f };
+		for (int i = 0; i < numOfSamples; i += 8)
+		{
+			SampleCosineHemisphere8(&us[i], &vs[i], normalX, normalY, normalZ, outX, outY, outZ);
+			sum += Vec3f(outX[0], outY[0], outZ[0]);
+		}
+	}) << std::endl;
+	if (sum.x == 0.0f)
+	{
+		std::cout << std::endl;
+	}
+
+	return isPassing;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Compares rays per second of the BVH against a linear scan over every hit object, and of each SIMD sphere kernel
+void RunBVHBenchmark();
+
+// Compares the cost of ray sphere intersection and shading with Vec3f passed by value to an out of line function,
+// with inlined Vec3f taken by const reference, and with Vec3fSSE
+void RunVectorBenchmark();
+
+// Measures the worst error of every FastMath.h approximation against libm over a sweep of inputs, and how long each
+// takes. Returns false if any of them is outside the error bound its comment gives.
+bool RunFastMathCheck();
+
+// Checks the closed form disk, ball and hemisphere samplers of Sampling.h against the moments of their distributions
+// and their 8 wide versions against the single sample ones, then times them against the rejection sampling they
+// replaced. Returns false if any check fails.
+bool RunSamplingBenchmark();
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+
+#include "Framebuffer.h"
+#include "MathClass.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+// Makes the bright pixels of an image glow. The image is halved down a mip chain until it is no wider than the
+// blur resolution, so a small Gaussian there covers a wide area of the full image. The blur is separable, one pass
+// along the rows and one down the columns, and the result is scaled bilinearly back up the chain. Every stage runs
+// over blocks of rows on the thread pool, and all the buffers are allocated once in Setup.
+class BloomPass
+{
+public:
+	BloomPass()
+		:m_width(0)
+		,m_height(0)
+	{
+	}
+
+	void Setup(int width, int height, int blurResolution = 512)
+	{
+		m_width = width;
+		m_height = height;
+
+		m_mipLevels.clear();
+		int levelWidth = width;
+		int levelHeight = height;
+		while (levelWidth > blurResolution && levelHeight > 1)
+		{
+			levelWidth = (levelWidth + 1) / 2;
+			levelHeight = (levelHeight + 1) / 2;
+			m_mipLevels.push_back(Framebuffer<Vec3f>());
+			m_mipLevels.back().Resize(levelWidth, levelHeight, Vec3f(0.0f, 0.0f, 0.0f));
+		}
+		m_blurTemp.Resize(levelWidth, levelHeight, Vec3f(0.0f, 0.0f, 0.0f));
+	}
+
+	// Replaces rPixels, which has to be the size given to Setup, with its bloom
+	void Apply(Framebuffer<Vec3f>& rPixels, ThreadPool& rThreadPool)
+	{
+		assert(rPixels.GetWidth() == m_width && rPixels.GetHeight() == m_height);
+		PROFILE_SCOPE("Bloom");
+
+		for (size_t level = 0; level < m_mipLevels.size(); level++)
+		{
+			Downsample(level == 0 ? rPixels : m_mipLevels[level - 1], m_mipLevels[level], rThreadPool);
+		}
+
+		Framebuffer<Vec3f>& rBlurLevel = m_mipLevels.empty() ? rPixels : m_mipLevels.back();
+		BlurRows(rBlurLevel, m_blurTemp, rThreadPool);
+		BlurColumns(m_blurTemp, rBlurLevel, rThreadPool);
+
+		for (int level = static_cast<int>(m_mipLevels.size()) - 1; level >= 0; level--)
+		{
+			Upsample(m_mipLevels[level], level == 0 ? rPixels : m_mipLevels[level - 1], rThreadPool);
+		}
+	}
+
+private:
+	static const int s_numOfWeights = 5;
+
+	static float GetWeight(int offset)
+	{
+		static const float weights[s_numOfWeights] = { 0.227027f, 0.1945946f, 0.1216216f, 0.054054f, 0.016216f };
+		return weights[offset < 0 ? -offset : offset];
+	}
+
+	// Averages every 2x2 block of source pixels, the last row and column are repeated for odd sizes
+	static void Downsample(Framebuffer<Vec3f>& rSource, Framebuffer<Vec3f>& rDestination, ThreadPool& rThreadPool)
+	{
+		const int sourceWidth = rSource.GetWidth();
+		const int sourceHeight = rSource.GetHeight();
+		rThreadPool.ForEachRow(rDestination.GetHeight(), [&](int y)
+		{
+			Vec3f* pTop = rSource.GetRow(2 * y);
+			Vec3f* pBottom = rSource.GetRow(std::min(2 * y + 1, sourceHeight - 1));
+			Vec3f* pDestination = rDestination.GetRow(y);
+			for (int x = 0; x < rDestination.GetWidth(); x++)
+			{
+				const int left = 2 * x;
+				const int right = std::min(2 * x + 1, sourceWidth - 1);
+				pDestination[x] = (pTop[left] + pTop[right] + pBottom[left] + pBottom[right]) * 0.25f;
+			}
+		});
+	}
+
+	// Bilinear, sampling the source at the centre of every destination pixel
+	static void Upsample(Framebuffer<Vec3f>& rSource, Framebuffer<Vec3f>& rDestination, ThreadPool& rThreadPool)
+	{
+		const int sourceWidth = rSource.GetWidth();
+		const int sourceHeight = rSource.GetHeight();
+		const float scaleX = static_cast<float>(sourceWidth) / static_cast<float>(rDestination.GetWidth());
+		const float scaleY = static_cast<float>(sourceHeight) / static_cast<float>(rDestination.GetHeight());
+		rThreadPool.ForEachRow(rDestination.GetHeight(), [&](int y)
+		{
+			const float sourceY = std::max(0.0f, (y + 0.5f) * scaleY - 0.5f);
+			const int topY = std::min(static_cast<int>(sourceY), sourceHeight - 1);
+			const float ty = sourceY - topY;
+			Vec3f* pTop = rSource.GetRow(topY);
+			Vec3f* pBottom = rSource.GetRow(std::min(topY + 1, sourceHeight - 1));
+			Vec3f* pDestination = rDestination.GetRow(y);
+			for (int x = 0; x < rDestination.GetWidth(); x++)
+			{
+				const float sourceX = std::max(0.0f, (x + 0.5f) * scaleX - 0.5f);
+				const int leftX = std::min(static_cast<int>(sourceX), sourceWidth - 1);
+				const int rightX = std::min(leftX + 1, sourceWidth - 1);
+				const float tx = sourceX - leftX;
+				Vec3f top = LERP(pTop[leftX], pTop[rightX], tx);
+				Vec3f bottom = LERP(pBottom[leftX], pBottom[rightX], tx);
+				pDestination[x] = LERP(top, bottom, ty);
+			}
+		});
+	}
+
+	// Pixels past the edge of the image repeat the edge pixel
+	static void BlurRows(Framebuffer<Vec3f>& rSource, Framebuffer<Vec3f>& rDestination, ThreadPool& rThreadPool)
+	{
+		const int width = rSource.GetWidth();
+		rThreadPool.ForEachRow(rSource.GetHeight(), [&](int y)
+		{
+			Vec3f* pSource = rSource.GetRow(y);
+			Vec3f* pDestination = rDestination.GetRow(y);
+			for (int x = 0; x < width; x++)
+			{
+				Vec3f result = pSource[x] * GetWeight(0);
+				for (int j = 1; j < s_numOfWeights; j++)
+				{
+					result += pSource[std::max(x - j, 0)] * GetWeight(j);
+					result += pSource[std::min(x + j, width - 1)] * GetWeight(j);
+				}
+				pDestination[x] = result;
+			}
+		});
+	}
+
+	// Works a row at a time too, adding whole neighbouring rows, so it reads memory in order instead of down columns
+	static void BlurColumns(Framebuffer<Vec3f>& rSource, Framebuffer<Vec3f>& rDestination, ThreadPool& rThreadPool)
+	{
+		const int width = rSource.GetWidth();
+		const int height = rSource.GetHeight();
+		rThreadPool.ForEachRow(height, [&](int y)
+		{
+			Vec3f* pDestination = rDestination.GetRow(y);
+			for (int x = 0; x < width; x++)
+			{
+				pDestination[x] = Vec3f(0.0f, 0.0f, 0.0f);
+			}
+
+			for (int j = 1 - s_numOfWeights; j < s_numOfWeights; j++)
+			{
+				Vec3f* pSource = rSource.GetRow(std::min(std::max(y + j, 0), height - 1));
+				const float weight = GetWeight(j);
+				for (int x = 0; x < width; x++)
+				{
+					pDestination[x] += pSource[x] * weight;
+				}
+			}
+		});
+	}
+
+	int m_width;
+	int m_height;
+	std::vector<Framebuffer<Vec3f>> m_mipLevels; // Each half the size of the one before, starting at half the image
+	Framebuffer<Vec3f> m_blurTemp;				 // Rows blurred, columns not yet
+};
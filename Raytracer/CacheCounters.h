@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum CacheCounter
+{
+	enL1DataReadMisses,
+	enLastLevelCacheMisses,
+	enNumOfCacheCounters
+};
+
+static const char* g_cacheCounterNames[enNumOfCacheCounters] = { "l1dReadMisses", "llcMisses" };
+
+// Hardware cache miss counters of the thread that made them, read with perf_event_open on Linux. On other platforms,
+// and where the kernel or a virtual machine doesn't give access to the counters, IsAvailable is false and the
+// counts read 0.
+class CacheCounters
+{
+public:
+	CacheCounters()
+	{
+		for (int counter = 0; counter < enNumOfCacheCounters; counter++)
+		{
+			m_files[counter] = -1;
+		}
+
+#if defined(__linux__)
+		const uint64_t configs[enNumOfCacheCounters] =
+		{
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_CACHE_MISSES,
+		};
+		const uint32_t types[enNumOfCacheCounters] = { PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+		for (int counter = 0; counter < enNumOfCacheCounters; counter++)
+		{
+			perf_event_attr attributes;
+			memset(&attributes, 0, sizeof(attributes));
+			attributes.size = sizeof(attributes);
+			attributes.type = types[counter];
+			attributes.config = configs[counter];
+			attributes.disabled = 1;
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			m_files[counter] = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+		}
+#endif
+	}
+
+	~CacheCounters()
+	{
+#if defined(__linux__)
+		for (int counter = 0; counter < enNumOfCacheCounters; counter++)
+		{
+			if (m_files[counter] >= 0)
+			{
+				close(m_files[counter]);
+			}
+		}
+#endif
+	}
+
+	CacheCounters(const CacheCounters&) = delete;
+	CacheCounters& operator=(const CacheCounters&) = delete;
+
+	bool IsAvailable(CacheCounter counter) const
+	{
+		return m_files[counter] >= 0;
+	}
+
+	// Zeroes the counts and starts counting
+	void Start()
+	{
+#if defined(__linux__)
+		for (int counter = 0; counter < enNumOfCacheCounters; counter++)
+		{
+			if (m_files[counter] >= 0)
+			{
+				ioctl(m_files[counter], PERF_EVENT_IOC_RESET, 0);
+				ioctl(m_files[counter], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	}
+
+	void Stop()
+	{
+#if defined(__linux__)
+		for (int counter = 0; counter < enNumOfCacheCounters; counter++)
+		{
+			if (m_files[counter] >= 0)
+			{
+				ioctl(m_files[counter], PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+#endif
+	}
+
+	uint64_t GetCount(CacheCounter counter) const
+	{
+		uint64_t count = 0;
+#if defined(__linux__)
+		if (m_files[counter] >= 0 && read(m_files[counter], &count, sizeof(count)) != sizeof(count))
+		{
+			count = 0;
+		}
+#endif
+		return count;
+	}
+
+private:
+	int m_files[enNumOfCacheCounters];
+};
@@ -1,16 +1,7 @@
 #pragma once
 
 #include "Ray.h"
-
-static Vec3f RandomInUnitDisk()
-{
-	Vec3f p;
-	do
-	{
-		p = Vec3f(GetRandomNum(), GetRandomNum(), 0.0f) * 2.0f - Vec3f(1.0f, 1.0f, 0.0f);
-	} while (p.dot(p) >= 1.0f);
-	return p;
-}
+#include "Sampler.h"
 
 class Camera
 {
@@ -35,9 +26,9 @@ public:
 		m_vertical = m_v * halfHeight * 2 * focusDistance;
 	}
 
-	Ray CastRay(float u, float v)
+	Ray CastRay(float u, float v, Sampler& rSampler)
 	{
-		Vec3f rd =  RandomInUnitDisk() * m_lensRadius;
+		Vec3f rd =  rSampler.GetPointInUnitDisk() * m_lensRadius;
 		Vec3f offset = m_u * rd.x + m_v * rd.y;
 		return Ray(m_origin + offset, m_lowerLeftCorner + m_horizontal * u + m_vertical * v - m_origin - offset);
 	}
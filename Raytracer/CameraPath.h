@@ -0,0 +1,95 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "MathClass.h"
+#include "Scene.h"
+
+struct CameraKeyframe
+{
+	float m_time; // Seconds
+	CameraSettings m_settings;
+};
+
+// Camera settings over time. Keyframes are added in time order and the settings between two of them are blended
+// linearly, so an animation only has to place the camera at a few points.
+class CameraPath
+{
+public:
+	void AddKeyframe(float time, const CameraSettings& settings)
+	{
+		assert(m_keyframes.empty() || time > m_keyframes.back().m_time);
+		CameraKeyframe keyframe;
+		keyframe.m_time = time;
+		keyframe.m_settings = settings;
+		m_keyframes.push_back(keyframe);
+	}
+
+	// Before the first keyframe and after the last one the camera holds still
+	CameraSettings Evaluate(float time) const
+	{
+		assert(!m_keyframes.empty());
+		if (time <= m_keyframes.front().m_time)
+		{
+			return m_keyframes.front().m_settings;
+		}
+
+		size_t next = 1;
+		while (next < m_keyframes.size() && m_keyframes[next].m_time < time)
+		{
+			next++;
+		}
+		if (next == m_keyframes.size())
+		{
+			return m_keyframes.back().m_settings;
+		}
+
+		const CameraKeyframe& rFrom = m_keyframes[next - 1];
+		const CameraKeyframe& rTo = m_keyframes[next];
+		const float t = (time - rFrom.m_time) / (rTo.m_time - rFrom.m_time);
+
+		CameraSettings settings;
+		settings.m_lookFrom = LERP(rFrom.m_settings.m_lookFrom, rTo.m_settings.m_lookFrom, t);
+		settings.m_lookAt = LERP(rFrom.m_settings.m_lookAt, rTo.m_settings.m_lookAt, t);
+		settings.m_up = LERP(rFrom.m_settings.m_up, rTo.m_settings.m_up, t);
+		settings.m_verticalFov = LERP(rFrom.m_settings.m_verticalFov, rTo.m_settings.m_verticalFov, t);
+		settings.m_aperture = LERP(rFrom.m_settings.m_aperture, rTo.m_settings.m_aperture, t);
+		settings.m_focusDistance = LERP(rFrom.m_settings.m_focusDistance, rTo.m_settings.m_focusDistance, t);
+		return settings;
+	}
+
+	float GetDuration() const
+	{
+		return m_keyframes.empty() ? 0.0f : m_keyframes.back().m_time - m_keyframes.front().m_time;
+	}
+
+	float GetStartTime() const
+	{
+		return m_keyframes.empty() ? 0.0f : m_keyframes.front().m_time;
+	}
+
+private:
+	std::vector<CameraKeyframe> m_keyframes;
+};
+
+// Swings the camera's eye around the point it looks at by degrees about the y axis, over duration seconds. Keyframes
+// no more than 15 degrees apart keep the straight lines between them close to the circle.
+static void MakeOrbitPath(const CameraSettings& camera, float degrees, float duration, CameraPath& rPath)
+{
+	const int numOfKeyframes = std::max(2, static_cast<int>(ceilf(fabsf(degrees) / 15.0f)) + 1);
+	Vec3f lookAt = camera.m_lookAt;
+	Vec3f lookFrom = camera.m_lookFrom;
+	for (int i = 0; i < numOfKeyframes; i++)
+	{
+		const float t = static_cast<float>(i) / static_cast<float>(numOfKeyframes - 1);
+		Mat4f orbit = Translate(lookAt) * RotateY(degrees * t) * Translate(lookAt * -1.0f);
+		Vec4f eye = orbit * Vec4f(lookFrom.x, lookFrom.y, lookFrom.z, 1.0f);
+
+		CameraSettings settings = camera;
+		settings.m_lookFrom = Vec3f(eye.x, eye.y, eye.z);
+		rPath.AddKeyframe(duration * t, settings);
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "MathClass.h"
+#include "Simd.h"
+
+// Uncomment to shade with the approximations below. Left off, the Shading* functions are the exact libm versions,
+// so renders stay bit for bit the same as the reference images.
+//#define FAST_SHADING_MATH
+
+// Highest exponent FastPow works out by multiplying, anything above goes to powf
+#define FAST_POW_MAX_EXPONENT 64
+
+// 1 / sqrt(x) for x > 0. The SSE estimate is good to 12 bits and one Newton-Raphson step takes it to within
+// 5e-7 relative error. Elsewhere the integer bit trick estimate needs two steps to get within 5e-6.
+inline float FastRsqrt(float x)
+{
+#if defined(SIMD_X86)
+	const float estimate = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+	return estimate * (1.5f - 0.5f * x * estimate * estimate);
+#else
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	bits = 0x5f375a86u - (bits >> 1);
+	float estimate;
+	memcpy(&estimate, &bits, sizeof(estimate));
+	estimate = estimate * (1.5f - 0.5f * x * estimate * estimate);
+	return estimate * (1.5f - 0.5f * x * estimate * estimate);
+#endif
+}
+
+#if defined(SIMD_X86)
+// FastRsqrt of 4 values at once, same error
+inline __m128 FastRsqrt(__m128 x)
+{
+	const __m128 estimate = _mm_rsqrt_ps(x);
+	const __m128 estimateSquared = _mm_mul_ps(estimate, estimate);
+	return _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), estimateSquared)));
+}
+#endif
+
+// Unit length to within FastRsqrt's error, and like Vec3f::normalize a zero vector stays zero
+inline Vec3f FastNormalize(const Vec3f& v)
+{
+	const float lengthSquared = v.dot(v);
+	return lengthSquared > 0.0f ? v * FastRsqrt(lengthSquared) : Vec3f();
+}
+
+// x to the power of a whole number, by repeated squaring. Every squaring doubles the rounding error carried into it,
+// so the result is within one ulp of the exact power per unit of exponent, where powf is within half an ulp.
+inline float PowInt(float x, int exponent)
+{
+	float result = 1.0f;
+	while (exponent > 0)
+	{
+		if (exponent & 1)
+		{
+			result *= x;
+		}
+		x *= x;
+		exponent >>= 1;
+	}
+	return result;
+}
+
+// powf for the whole number exponents material shininess usually is, falling back to powf for the rest
+inline float FastPow(float x, float exponent)
+{
+	const int wholeExponent = static_cast<int>(exponent);
+	if (static_cast<float>(wholeExponent) == exponent && wholeExponent >= 0 && wholeExponent <= FAST_POW_MAX_EXPONENT)
+	{
+		return PowInt(x, wholeExponent);
+	}
+	return powf(x, exponent);
+}
+
+// Directions from a surface point to the light and to the eye, and the Blinn-Phong half vector between them, with
+// the three normalizes done with reciprocal square roots. The light direction is within 1e-6 of exact and the half
+// vector within 1e-5, except when the light is almost straight behind the point from the eye, where the half vector
+// is the sum of two nearly opposite vectors and can't be found accurately by any method.
+inline void GetLightAndHalfVectors(const Vec3f& point, const Vec3f& lightPosition, const Vec3f& eyePosition, Vec3f& rLightDir, Vec3f& rHalfVector)
+{
+	const Vec3f toLight = lightPosition - point;
+	const Vec3f toEye = eyePosition - point;
+#if defined(SIMD_X86)
+	// Both lengths go through one rsqrt, the half vector needs the unit directions so it gets a second
+	const float toLightLengthSquared = toLight.dot(toLight);
+	const float toEyeLengthSquared = toEye.dot(toEye);
+	alignas(16) float inverseLengths[4];
+	_mm_store_ps(inverseLengths, FastRsqrt(_mm_set_ps(1.0f, 1.0f, toEyeLengthSquared, toLightLengthSquared)));
+	rLightDir = toLightLengthSquared > 0.0f ? toLight * inverseLengths[0] : Vec3f();
+	const Vec3f eyeDir = toEyeLengthSquared > 0.0f ? toEye * inverseLengths[1] : Vec3f();
+#else
+	rLightDir = FastNormalize(toLight);
+	const Vec3f eyeDir = FastNormalize(toEye);
+#endif
+	rHalfVector = FastNormalize(rLightDir + eyeDir);
+}
+
+// What the shading code calls, exact unless FAST_SHADING_MATH is defined
+inline Vec3f ShadingNormalize(const Vec3f& v)
+{
+#if defined(FAST_SHADING_MATH)
+	return FastNormalize(v);
+#else
+	return v.normalize();
+#endif
+}
+
+inline float ShadingPow(float x, float exponent)
+{
+#if defined(FAST_SHADING_MATH)
+	return FastPow(x, exponent);
+#else
+	return powf(x, exponent);
+#endif
+}
+
+inline void GetShadingLightAndHalfVectors(const Vec3f& point, const Vec3f& lightPosition, const Vec3f& eyePosition, Vec3f& rLightDir, Vec3f& rHalfVector)
+{
+#if defined(FAST_SHADING_MATH)
+	GetLightAndHalfVectors(point, lightPosition, eyePosition, rLightDir, rHalfVector);
+#else
+	rLightDir = (lightPosition - point).normalize();
+	rHalfVector = (rLightDir + (eyePosition - point).normalize()).normalize();
+#endif
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "AlignedAllocator.h"
+
+#define FRAMEBUFFER_ALIGNMENT 64
+
+// 2D image allocated once up front and addressed by (x, y). Every row starts on a cache line, so threads writing
+// tiles that begin on different rows, or on a tile boundary of the same row, never share a cache line.
+template <typename T>
+class Framebuffer
+{
+public:
+	Framebuffer()
+		:m_width(0)
+		,m_height(0)
+		,m_stride(0)
+	{
+	}
+
+	// Only reallocates when the image gets bigger
+	void Resize(int width, int height, const T& value)
+	{
+		// Round the row length up to a whole number of cache lines
+		int pixelsPerAlignment = 1;
+		while ((pixelsPerAlignment * sizeof(T)) % FRAMEBUFFER_ALIGNMENT != 0)
+		{
+			pixelsPerAlignment++;
+		}
+
+		m_width = width;
+		m_height = height;
+		m_stride = ((width + pixelsPerAlignment - 1) / pixelsPerAlignment) * pixelsPerAlignment;
+		m_pixels.assign(static_cast<size_t>(m_stride) * height, value);
+	}
+
+	void Fill(const T& value)
+	{
+		std::fill(m_pixels.begin(), m_pixels.end(), value);
+	}
+
+	T& At(int x, int y)
+	{
+		return m_pixels[x + static_cast<size_t>(m_stride) * y];
+	}
+
+	const T& At(int x, int y) const
+	{
+		return m_pixels[x + static_cast<size_t>(m_stride) * y];
+	}
+
+	T* GetRow(int y)
+	{
+		return &m_pixels[static_cast<size_t>(m_stride) * y];
+	}
+
+	const T* GetRow(int y) const
+	{
+		return &m_pixels[static_cast<size_t>(m_stride) * y];
+	}
+
+	int GetWidth() const
+	{
+		return m_width;
+	}
+
+	int GetHeight() const
+	{
+		return m_height;
+	}
+
+	int GetStride() const
+	{
+		return m_stride;
+	}
+
+private:
+	int m_width;
+	int m_height;
+	int m_stride; // Pixels from the start of one row to the next
+	std::vector<T, AlignedAllocator<T, FRAMEBUFFER_ALIGNMENT>> m_pixels;
+};
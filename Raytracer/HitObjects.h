@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cfloat>
+#include <stdint.h>
+
+#include "FastMath.h"
 #include "Ray.h"
 
-class Material;
 class HitObject;
 
 struct HitRecord
@@ -10,35 +13,102 @@ struct HitRecord
 	Vec3f m_objectPosition;
 	Vec3f m_intersectPoint;
 	Vec3f m_normal;
-	Material* m_pMaterial;
+	uint32_t m_materialIndex; // Into the scene's materials
 	HitObject* m_pHitObject;
 };
 
-// An object that can be hit by a ray
-class HitObject
+// Axis aligned bounding box
+struct AABB
 {
-public:
-	~HitObject()
+	AABB()
+		:m_min(FLT_MAX, FLT_MAX, FLT_MAX)
+		,m_max(-FLT_MAX, -FLT_MAX, -FLT_MAX)
+	{
+	}
+
+	AABB(const Vec3f& min, const Vec3f& max)
+		:m_min(min)
+		,m_max(max)
+	{
+	}
+
+	void Grow(const Vec3f& point)
+	{
+		m_min = Vec3f(std::min(m_min.x, point.x), std::min(m_min.y, point.y), std::min(m_min.z, point.z));
+		m_max = Vec3f(std::max(m_max.x, point.x), std::max(m_max.y, point.y), std::max(m_max.z, point.z));
+	}
+
+	void Grow(const AABB& other)
+	{
+		Grow(other.m_min);
+		Grow(other.m_max);
+	}
+
+	Vec3f GetCentroid() const
+	{
+		return (m_min + m_max) * 0.5f;
+	}
+
+	float GetSurfaceArea() const
 	{
-		delete m_pMaterial;
+		Vec3f extent = m_max - m_min;
+		if (extent.x < 0.0f)
+		{
+			return 0.0f;
+		}
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	// Slab test, returns the distance the ray enters the box or FLT_MAX if it misses
+	float HitDistance(const Vec3f& origin, const Vec3f& invDirection, float minHitDistance, float maxHitDistance) const
+	{
+		float tx1 = (m_min.x - origin.x) * invDirection.x;
+		float tx2 = (m_max.x - origin.x) * invDirection.x;
+		float tMin = std::min(tx1, tx2);
+		float tMax = std::max(tx1, tx2);
+
+		float ty1 = (m_min.y - origin.y) * invDirection.y;
+		float ty2 = (m_max.y - origin.y) * invDirection.y;
+		tMin = std::max(tMin, std::min(ty1, ty2));
+		tMax = std::min(tMax, std::max(ty1, ty2));
+
+		float tz1 = (m_min.z - origin.z) * invDirection.z;
+		float tz2 = (m_max.z - origin.z) * invDirection.z;
+		tMin = std::max(tMin, std::min(tz1, tz2));
+		tMax = std::min(tMax, std::max(tz1, tz2));
+
+		if (tMax >= tMin && tMax > minHitDistance && tMin < maxHitDistance)
+		{
+			return tMin;
+		}
+		return FLT_MAX;
 	}
 
-	virtual bool HasHit(Ray r, float minHitDistance, float& rMaxHitDistance, HitRecord& rHitRecord) = 0;
+	Vec3f m_min;
+	Vec3f m_max;
+};
+
+// An object that can be hit by a ray
+class HitObject
+{
+public:
+	virtual bool HasHit(const Ray& r, float minHitDistance, float& rMaxHitDistance, HitRecord& rHitRecord) = 0;
+	virtual AABB GetBoundingBox() = 0;
 	Vec3f m_position;
-	Material* m_pMaterial;
+	uint32_t m_materialIndex; // Into the scene's materials
 };
 
 class Sphere : public HitObject
 {
 public:
-	Sphere(Vec3f center, float radius, Material* pMaterial)
+	Sphere(const Vec3f& center, float radius, uint32_t materialIndex)
 	{
 		m_position = center;
 		m_radius = radius;
-		m_pMaterial = pMaterial;
+		m_materialIndex = materialIndex;
 	}
 
-	virtual bool HasHit(Ray r, float minHitDistance, float& rMaxHitDistance, HitRecord& rHitRecord)
+	virtual bool HasHit(const Ray& r, float minHitDistance, float& rMaxHitDistance, HitRecord& rHitRecord)
 	{
 		bool hasHitSphere = false;
 
@@ -49,27 +119,20 @@ public:
 		float discriminant = b * b - a * c;
 		if (discriminant > 0)
 		{
-			float t = (-b - sqrtf(b * b - a * c)) / a;
+			const float root = sqrtf(discriminant);
+			float t = (-b - root) / a;
 			if (t < rMaxHitDistance && t > minHitDistance)
 			{
 				rMaxHitDistance = t;
-				rHitRecord.m_intersectPoint = r.GetPointAtParameter(t);
-				rHitRecord.m_objectPosition = m_position;
-				rHitRecord.m_normal = (rHitRecord.m_intersectPoint - rHitRecord.m_objectPosition).normalize();
-				rHitRecord.m_pMaterial = m_pMaterial;
-				rHitRecord.m_pHitObject = this;
+				SetHitRecord(r, t, rHitRecord);
 				hasHitSphere = true;
 			}
 
-			t = (-b + sqrtf(b * b - a * c)) / a;
+			t = (-b + root) / a;
 			if (t < rMaxHitDistance && t > minHitDistance)
 			{
 				rMaxHitDistance = t;
-				rHitRecord.m_intersectPoint = r.GetPointAtParameter(t);
-				rHitRecord.m_objectPosition = m_position;
-				rHitRecord.m_normal = (rHitRecord.m_intersectPoint - rHitRecord.m_objectPosition).normalize();
-				rHitRecord.m_pMaterial = m_pMaterial;
-				rHitRecord.m_pHitObject = this;
+				SetHitRecord(r, t, rHitRecord);
 				hasHitSphere = true;
 			}
 		}
@@ -102,21 +165,36 @@ public:
 		return hasHitSphere;
 	}
 
+	void SetHitRecord(const Ray& r, float t, HitRecord& rHitRecord)
+	{
+		rHitRecord.m_intersectPoint = r.GetPointAtParameter(t);
+		rHitRecord.m_objectPosition = m_position;
+		rHitRecord.m_normal = ShadingNormalize(rHitRecord.m_intersectPoint - rHitRecord.m_objectPosition);
+		rHitRecord.m_materialIndex = m_materialIndex;
+		rHitRecord.m_pHitObject = this;
+	}
+
+	virtual AABB GetBoundingBox()
+	{
+		Vec3f extent(m_radius, m_radius, m_radius);
+		return AABB(m_position - extent, m_position + extent);
+	}
+
 	float m_radius;
 };
 
 class LightSphere : public Sphere
 {
 public:
-	LightSphere(Vec3f center, float radius, float lightRadius, float lightIntensity, Material* pMaterial)
-		:Sphere(center, radius, pMaterial)
+	LightSphere(const Vec3f& center, float radius, float lightRadius, float lightIntensity, uint32_t materialIndex)
+		:Sphere(center, radius, materialIndex)
 		,m_isLightHit(false)
 		,m_lightIntensity(lightIntensity)
 	{
 		m_lightRadius = (lightRadius > radius) ? lightRadius : radius;
 	}
 
-	virtual bool HasHit(Ray r, float minHitDistance, float& rMaxHitDistance, HitRecord& rHitRecord)
+	virtual bool HasHit(const Ray& r, float minHitDistance, float& rMaxHitDistance, HitRecord& rHitRecord)
 	{
 		bool hasHitSphere = false;
 
@@ -138,7 +216,7 @@ public:
 					rHitRecord.m_intersectPoint = r.GetPointAtParameter(t);
 					rHitRecord.m_objectPosition = m_position;
 					rHitRecord.m_normal = (rHitRecord.m_intersectPoint - rHitRecord.m_objectPosition).normalize();
-					rHitRecord.m_pMaterial = m_pMaterial;
+					rHitRecord.m_materialIndex = m_materialIndex;
 					rHitRecord.m_pHitObject = this;
 					hasHitSphere = true;
 					m_isLightHit = true;
@@ -151,7 +229,7 @@ public:
 					rHitRecord.m_intersectPoint = r.GetPointAtParameter(t);
 					rHitRecord.m_objectPosition = m_position;
 					rHitRecord.m_normal = (rHitRecord.m_intersectPoint - rHitRecord.m_objectPosition).normalize();
-					rHitRecord.m_pMaterial = m_pMaterial;
+					rHitRecord.m_materialIndex = m_materialIndex;
 					rHitRecord.m_pHitObject = this;
 					hasHitSphere = true;
 					m_isLightHit = true;
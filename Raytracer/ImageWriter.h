@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "MathClass.h"
+
+// Writes a whole buffer to a file with a single call, returns false if the file couldn't be opened or fully written
+static bool WriteFileBuffer(const char* fileName, const std::vector<char>& buffer)
+{
+	FILE* pFile = fopen(fileName, "wb");
+	if (pFile == nullptr)
+	{
+		return false;
+	}
+
+	const size_t written = fwrite(buffer.data(), 1, buffer.size(), pFile);
+	const bool isClosed = fclose(pFile) == 0;
+	return written == buffer.size() && isClosed;
+}
+
+// Binary PPM (P6) from 8 bit RGB pixels, top row first
+static bool WritePPM(const char* fileName, int width, int height, const std::vector<uint8_t>& rgb)
+{
+	const std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+
+	std::vector<char> buffer(header.size() + rgb.size());
+	memcpy(buffer.data(), header.data(), header.size());
+	memcpy(buffer.data() + header.size(), rgb.data(), rgb.size());
+
+	return WriteFileBuffer(fileName, buffer);
+}
+
+// Floating point PFM from HDR pixels, top row first. PFM stores the bottom row first, and the sign of the scale
+// gives the byte order of the floats, negative for little endian. They are written in the host's order.
+static bool WritePFM(const char* fileName, int width, int height, const std::vector<Vec3f>& pixels)
+{
+	const uint32_t one = 1;
+	uint8_t lowestByte = 0;
+	memcpy(&lowestByte, &one, 1);
+	const std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + (lowestByte == 1 ? "\n-1.0\n" : "\n1.0\n");
+	const size_t rowSize = width * 3 * sizeof(float);
+
+	std::vector<char> buffer(header.size() + rowSize * height);
+	memcpy(buffer.data(), header.data(), header.size());
+
+	char* pRow = buffer.data() + header.size();
+	for (int y = height - 1; y >= 0; y--)
+	{
+		// The header leaves the rows unaligned, so the floats are copied in rather than stored through a float pointer
+		for (int x = 0; x < width; x++)
+		{
+			const Vec3f& pixel = pixels[x + (width * y)];
+			const float values[3] = { pixel.r, pixel.g, pixel.b };
+			memcpy(pRow + x * sizeof(values), values, sizeof(values));
+		}
+		pRow += rowSize;
+	}
+
+	return WriteFileBuffer(fileName, buffer);
+}
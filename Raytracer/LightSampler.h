@@ -0,0 +1,167 @@
+#pragma once
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "HitObjects.h"
+#include "Materials.h"
+#include "Random.h"
+
+#define LIGHT_SELECTION_CANDIDATES 4
+
+// Picks one of n items with probability proportional to its weight in constant time (Vose's alias method)
+class AliasTable
+{
+public:
+	void Build(const std::vector<float>& weights)
+	{
+		const int count = static_cast<int>(weights.size());
+		m_probabilities.assign(count, 1.0f);
+		m_aliases.assign(count, 0);
+		m_pdfs.assign(count, 0.0f);
+
+		float totalWeight = 0.0f;
+		for (float weight : weights)
+		{
+			totalWeight += weight;
+		}
+
+		// Weights scaled so the average is 1, split into the ones under and over the average
+		std::vector<float> scaledWeights(count);
+		std::vector<int> small;
+		std::vector<int> large;
+		for (int i = 0; i < count; i++)
+		{
+			m_pdfs[i] = totalWeight > 0.0f ? weights[i] / totalWeight : 1.0f / count;
+			scaledWeights[i] = m_pdfs[i] * count;
+			(scaledWeights[i] < 1.0f ? small : large).push_back(i);
+		}
+
+		// Every slot gets filled up to 1 by one of the large items
+		while (!small.empty() && !large.empty())
+		{
+			const int smallIndex = small.back();
+			small.pop_back();
+			const int largeIndex = large.back();
+			large.pop_back();
+
+			m_probabilities[smallIndex] = scaledWeights[smallIndex];
+			m_aliases[smallIndex] = largeIndex;
+			scaledWeights[largeIndex] = (scaledWeights[largeIndex] + scaledWeights[smallIndex]) - 1.0f;
+			(scaledWeights[largeIndex] < 1.0f ? small : large).push_back(largeIndex);
+		}
+
+		// Whatever is left over is 1 give or take rounding
+		for (int i : small)
+		{
+			m_probabilities[i] = 1.0f;
+		}
+		for (int i : large)
+		{
+			m_probabilities[i] = 1.0f;
+		}
+	}
+
+	int Sample(Random& rRandom) const
+	{
+		const int count = static_cast<int>(m_probabilities.size());
+		const int slot = std::min(static_cast<int>(rRandom.NextFloat() * count), count - 1);
+		return rRandom.NextFloat() < m_probabilities[slot] ? slot : m_aliases[slot];
+	}
+
+	float GetPdf(int index) const
+	{
+		return m_pdfs[index];
+	}
+
+	bool IsEmpty() const
+	{
+		return m_pdfs.empty();
+	}
+
+private:
+	std::vector<float> m_probabilities; // Chance of keeping a slot's own item rather than its alias
+	std::vector<int> m_aliases;
+	std::vector<float> m_pdfs;
+};
+
+// Chooses which light a hit point takes its direct lighting from, so the cost of a bounce doesn't grow with the
+// number of lights. A few candidates are drawn from an alias table weighted by light power, and one of them is
+// kept with probability proportional to its power after falloff over the distance to the point (resampled
+// importance sampling). The returned weight makes the lighting of the one light an unbiased estimate of the sum
+// of the lighting of all the lights. Their shadows don't add up that way, GetShadowedLighting has how they are
+// estimated.
+class LightSampler
+{
+public:
+	void Build(const std::vector<HitObject*>& lightObjects, const std::vector<Material>& materials)
+	{
+		m_lights.clear();
+		m_powers.clear();
+		for (HitObject* pLightObject : lightObjects)
+		{
+			LightSphere* pLight = static_cast<LightSphere*>(pLightObject);
+			const Vec3f& colour = materials[pLight->m_materialIndex].m_diffuseColour;
+			const float luminance = 0.2126f * colour.r + 0.7152f * colour.g + 0.0722f * colour.b;
+			m_lights.push_back(pLight);
+			m_powers.push_back(pLight->m_lightIntensity * luminance);
+		}
+		m_aliasTable.Build(m_powers);
+	}
+
+	// Returns nullptr when none of the candidates reach the point
+	LightSphere* Sample(const Vec3f& point, Random& rRandom, float& rWeight) const
+	{
+		rWeight = 0.0f;
+		if (m_aliasTable.IsEmpty())
+		{
+			return nullptr;
+		}
+
+		int chosenLight = -1;
+		float chosenTargetWeight = 0.0f;
+		float totalWeight = 0.0f;
+		for (int i = 0; i < LIGHT_SELECTION_CANDIDATES; i++)
+		{
+			const int light = m_aliasTable.Sample(rRandom);
+			const float targetWeight = GetTargetWeight(light, point);
+			if (targetWeight <= 0.0f)
+			{
+				continue;
+			}
+
+			const float weight = targetWeight / m_aliasTable.GetPdf(light);
+			totalWeight += weight;
+			if (rRandom.NextFloat() * totalWeight < weight)
+			{
+				chosenLight = light;
+				chosenTargetWeight = targetWeight;
+			}
+		}
+
+		if (chosenLight < 0)
+		{
+			return nullptr;
+		}
+
+		rWeight = totalWeight / (LIGHT_SELECTION_CANDIDATES * chosenTargetWeight);
+		return m_lights[chosenLight];
+	}
+
+private:
+	// Power with the same linear falloff CalcLighting uses, 0 outside the light's range
+	float GetTargetWeight(int light, const Vec3f& point) const
+	{
+		const LightSphere* pLight = m_lights[light];
+		const float dx = point.x - pLight->m_position.x;
+		const float dy = point.y - pLight->m_position.y;
+		const float dz = point.z - pLight->m_position.z;
+		const float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+		return m_powers[light] * std::max(0.0f, 1.0f - distance / pLight->m_lightRadius);
+	}
+
+	std::vector<LightSphere*> m_lights;
+	std::vector<float> m_powers;
+	AliasTable m_aliasTable;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile()
+		:m_pData(nullptr)
+		,m_size(0)
+#if defined(_WIN32)
+		,m_file(INVALID_HANDLE_VALUE)
+		,m_mapping(nullptr)
+#endif
+	{
+	}
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const char* fileName)
+	{
+		Close();
+
+#if defined(_WIN32)
+		m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+		m_size = static_cast<size_t>(fileSize.QuadPart);
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping == nullptr)
+		{
+			Close();
+			return false;
+		}
+
+		m_pData = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int file = open(fileName, O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+		{
+			close(file);
+			return false;
+		}
+		m_size = static_cast<size_t>(fileStat.st_size);
+
+		m_pData = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (m_pData == MAP_FAILED)
+		{
+			m_pData = nullptr;
+		}
+#endif
+
+		if (m_pData == nullptr)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close()
+	{
+#if defined(_WIN32)
+		if (m_pData != nullptr)
+		{
+			UnmapViewOfFile(m_pData);
+		}
+		if (m_mapping != nullptr)
+		{
+			CloseHandle(m_mapping);
+			m_mapping = nullptr;
+		}
+		if (m_file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(m_file);
+			m_file = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (m_pData != nullptr)
+		{
+			munmap(m_pData, m_size);
+		}
+#endif
+		m_pData = nullptr;
+		m_size = 0;
+	}
+
+	const void* GetData() const
+	{
+		return m_pData;
+	}
+
+	size_t GetSize() const
+	{
+		return m_size;
+	}
+
+private:
+	void* m_pData;
+	size_t m_size;
+#if defined(_WIN32)
+	HANDLE m_file;
+	HANDLE m_mapping;
+#endif
+};
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "HitObjects.h"
+#include "Sampler.h"
 
 enum MaterialType
 {
@@ -9,99 +12,71 @@ enum MaterialType
 	enEmmisive
 };
 
-class Material
+// Plain data for every kind of material. A scene keeps them by value in one array that hit objects index into,
+// and Scatter switches on the type rather than making a virtual call, so each case can be inlined into the render loop.
+struct Material
 {
-public:
-	virtual bool Scatter(Ray inRay, HitRecord hitRecord, Ray& rScatteredRay) = 0;
-	Vec3f m_diffuseColour;
 	MaterialType m_materialType;
+	Vec3f m_diffuseColour;
 	float m_shininess; // Used in specular light calculation. The bigger the number, the more pronounces the highlight will be
+	float m_fuzzyness; // Metal only
+	float m_exposure;  // Emmisive only
 };
 
-class LambertianDiffuse : public Material
+inline Material MakeLambertianDiffuse(const Vec3f& diffuse)
 {
-public:
-	LambertianDiffuse(Vec3f diffuse)
-	{
-		m_diffuseColour = diffuse;
-		m_materialType = enLambertianDiffuse;
-		m_shininess = 1.0f;
-	}
+	Material material;
+	material.m_materialType = enLambertianDiffuse;
+	material.m_diffuseColour = diffuse;
+	material.m_shininess = 1.0f;
+	material.m_fuzzyness = 0.0f;
+	material.m_exposure = 0.0f;
+	return material;
+}
 
-	virtual bool Scatter(Ray inRay, HitRecord hitRecord, Ray& rScatteredRay)
-	{
-		Vec3f target = hitRecord.m_intersectPoint + hitRecord.m_normal + GetRandomUnitVecInSphere();
-		rScatteredRay = Ray(hitRecord.m_intersectPoint, target - hitRecord.m_intersectPoint);
-		return true;
-	}
-};
-
-class Metal : public Material
+inline Material MakeMetal(const Vec3f& diffuse, float fuzzyness)
 {
-public:
-	Metal(Vec3f diffuse, float fuzzyness)
-		:m_fuzzyness(fuzzyness)
-	{
-		m_diffuseColour = diffuse;
-		m_materialType = enMetal;
-		m_shininess = 5.0f;
-	}
+	Material material;
+	material.m_materialType = enMetal;
+	material.m_diffuseColour = diffuse;
+	material.m_shininess = 5.0f;
+	material.m_fuzzyness = fuzzyness;
+	material.m_exposure = 0.0f;
+	return material;
+}
 
-	virtual bool Scatter(Ray inRay, HitRecord hitRecord, Ray& rScatteredRay)
-	{
-		Vec3f reflected = Reflect(inRay.GetDirection().normalize(), hitRecord.m_normal);
-		rScatteredRay = Ray(hitRecord.m_intersectPoint, reflected + GetRandomUnitVecInSphere() * m_fuzzyness);
-		return (rScatteredRay.GetDirection().dot(hitRecord.m_normal) > 0);
-	}
-
-private:
-	float m_fuzzyness;
-};
+inline Material MakeEmmisive(const Vec3f& diffuse, float exposure)
+{
+	Material material;
+	material.m_materialType = enEmmisive;
+	material.m_diffuseColour = diffuse;
+	material.m_shininess = 0.0f;
+	material.m_fuzzyness = 0.0f;
+	material.m_exposure = exposure;
+	return material;
+}
 
-class Emmisive : public Material
+inline bool Scatter(const Material& material, const Ray& inRay, const HitRecord& hitRecord, Ray& rScatteredRay, Sampler& rSampler)
 {
-public:
-	Emmisive(Vec3f diffuse, float exposure)
+	Vec3f intersectPoint = hitRecord.m_intersectPoint;
+	Vec3f normal = hitRecord.m_normal;
+
+	switch (material.m_materialType)
+	{
+	case enLambertianDiffuse:
 	{
-		m_diffuseColour = diffuse;
-		m_materialType = enEmmisive;
-		m_shininess = 0.0f;
-		m_exposure = exposure;
+		rScatteredRay = Ray(intersectPoint, rSampler.GetCosineDirection(normal));
+		return true;
 	}
-
-	virtual bool Scatter(Ray inRay, HitRecord hitRecord, Ray& rScatteredRay)
+	case enMetal:
 	{
-		// For debugging lights
-		/*
-		LightSphere* pLightSphere = static_cast<LightSphere*>(hitRecord.m_pHitObject);
-		float hitDistance = (hitRecord.m_intersectPoint - hitRecord.m_objectPosition).magnitude();
-		if (hitDistance > pLightSphere->m_radius)
-		{
-			float distanceToSphere = pLightSphere->m_lightRadius - pLightSphere->m_radius;
-			Vec3f directionToSphere = (hitRecord.m_objectPosition - hitRecord.m_intersectPoint).normalize();
-			Vec3f sphereIntersectPoint = directionToSphere * distanceToSphere;
-			float attenuationDistance = (sphereIntersectPoint - hitRecord.m_intersectPoint).magnitude();
-			float attenuation = 1.0f / (1.0f + attenuationDistance * attenuationDistance);
-			if (attenuation < 0.0f)
-			{
-				attenuation = 0.0f;
-			}
-			else if (attenuation > 1.0f)
-			{
-				attenuation = 1.0f;
-			}
-			//rAttenuation = m_albedo * attenuation;
-			rAttenuation = m_albedo;
-			rScatteredRay = Ray(hitRecord.m_intersectPoint, hitRecord.m_intersectPoint + inRay.GetDirection().normalize());
-		}
-		else
-		*/
-		{
-			rScatteredRay = Ray(hitRecord.m_intersectPoint, hitRecord.m_objectPosition);
-		}
+		Vec3f reflected = Reflect(ShadingNormalize(inRay.GetDirection()), normal);
+		rScatteredRay = Ray(intersectPoint, reflected + rSampler.GetPointInUnitSphere() * material.m_fuzzyness);
+		return (rScatteredRay.GetDirection().dot(normal) > 0);
+	}
+	case enEmmisive:
+		rScatteredRay = Ray(intersectPoint, hitRecord.m_objectPosition);
 		return true;
 	}
-
-	float m_exposure;
-};
-
+	return false;
+}
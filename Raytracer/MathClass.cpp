@@ -1,132 +1,5 @@
 #include "MathClass.h"
 
-Vec3f::Vec3f()
-{
-	x = v[0] = 0.0f;
-	y = v[1] = 0.0f;
-	z = v[2] = 0.0f;
-}
-
-Vec3f::Vec3f(float x, float y, float z)
-{
-	this->x = v[0] = x;
-	this->y = v[1] = y;
-	this->z = v[2] = z;
-}
-
-Vec3f Vec3f::negate() //mathclass.cpp
-{
-	return Vec3f(-x, -y, -z);
-}
-
-Vec3f Vec3f::operator+ (const Vec3f &other)
-{
-	return Vec3f(x + other.x, y + other.y, z + other.z);
-}
-
-Vec3f Vec3f::operator- (const Vec3f &other)
-{
-	return Vec3f(x - other.x, y - other.y, z - other.z);
-}
-
-Vec3f Vec3f::operator* (const Vec3f &other)
-{
-	return Vec3f(x * other.x, y * other.y, z * other.z);
-}
-
-Vec3f Vec3f::operator* (float scale)
-{
-	return Vec3f(x * scale, y * scale, z * scale);
-}
-
-Vec3f Vec3f::operator+= (const Vec3f &other)
-{
-	return Vec3f(x += other.x, y += other.y, z += other.z); 
-}
-
-Vec3f Vec3f::operator*= (const Vec3f &other)
-{
-	return Vec3f(x *= other.x, y *= other.y, z *= other.z);
-}
-
-Vec3f Vec3f::operator*= (float scale)
-{
-	return Vec3f(x *= scale, y *= scale, z *= scale);
-}
-
-bool Vec3f::operator== (const Vec3f &other)
-{
-	if(x == other.x && y == other.y && z == other.z)
-	{
-		return true;
-	}
-	else
-	{
-		return false;
-	}
-}
-
-bool Vec3f::operator!= (const Vec3f &other)
-{
-	if(x == other.x && y == other.y && z == other.z)
-	{
-		return false;
-	}
-	else
-	{
-		return true;
-	}
-}
-
-bool Vec3f::operator<= (const Vec3f &other)
-{
-	if(x <= other.x && y <= other.y && z <= other.z)
-	{
-		return true;
-	}
-	else
-	{
-		return false;
-	}
-}
-
-float Vec3f::magnitude()
-{
-	return sqrtf((x * x) + (y * y) + (z * z));
-}
-
-Vec3f Vec3f::normalize()
-{
-	float mag = sqrtf((x * x) + (y * y) + (z * z));
-	if (mag != 0.0f) {
-		return Vec3f(x * (1.0f / mag), y * (1.0f / mag), z * (1.0f / mag));
-	}
-	else {
-		return Vec3f(); 
-	}
-}
-
-Vec3f Vec3f::square()
-{
-	return Vec3f((x * x), (y * y), (z * z));
-}
-
-float Vec3f::dot(const Vec3f &other)
-{
-	return (x * other.x) + (y * other.y) + (z * other.z);
-}
-
-Vec3f Vec3f::cross(const Vec3f &other)
-{
-	return Vec3f((y * other.z) - (other.y * z), (z * other.x) - (other.z * x), (x * other.y) - (other.x * y));
-}
-
-Vec3f Vec3f::dirVec(const Vec3f &other)
-{
-	Vec3f combined = Vec3f(x - other.x, y - other.y, z - other.z);
-	return combined.normalize();
-}
-
 std::ostream& operator<<(std::ostream& os, const Vec3f &v)
 {
 	std::cout << "(" << v.x << ", " << v.y << ", " << v.z << ")" << std::endl;
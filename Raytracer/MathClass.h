@@ -1,41 +1,136 @@
 #pragma once
+#include <math.h>
 #include <iostream>
 #include <algorithm>
 
+#include "Random.h"
+
 const float G = -9.81f; //gravity
 const float PI = 3.141592654f;
 const float DegreesToRadians = PI / 180.0f;
 const float RadiansToDegrees = 180.0f / PI;
 
-//3D vectors
+//3D vectors. Everything is defined here rather than in MathClass.cpp so it inlines into every file that uses it,
+//and everything that doesn't change the vector is const so it works on const references
 class Vec3f
 {
 public:
-	Vec3f();
-	Vec3f(float x, float y, float z);
+	constexpr Vec3f()
+		:x(0.0f), y(0.0f), z(0.0f)
+	{
+	}
 
-	Vec3f operator+ (const Vec3f &other);
-	Vec3f operator- (const Vec3f &other);
-	Vec3f operator* (const Vec3f &other);
-	Vec3f operator* (float scale);
-	/*Vec3f operator/ (Vec3f &other);*/
+	constexpr Vec3f(float x, float y, float z)
+		:x(x), y(y), z(z)
+	{
+	}
 
-	Vec3f operator+= (const Vec3f &other);
-	//Vec3f operator-= (Vec3f &other);
-	Vec3f operator*= (const Vec3f &other);
-	Vec3f operator*= (float scale);
-	bool operator == (const Vec3f &other);
-	bool operator != (const Vec3f &other);
-	bool operator <= (const Vec3f &other);
+	constexpr Vec3f operator+ (const Vec3f &other) const
+	{
+		return Vec3f(x + other.x, y + other.y, z + other.z);
+	}
 
-	float magnitude();
-	Vec3f normalize();
-	Vec3f square();
-	float dot(const Vec3f &other);	//dot product
-	Vec3f cross(const Vec3f &other);	//cross product
-	Vec3f dirVec(const Vec3f &other);		//direction of a vector between two points
+	constexpr Vec3f operator- (const Vec3f &other) const
+	{
+		return Vec3f(x - other.x, y - other.y, z - other.z);
+	}
+
+	constexpr Vec3f operator* (const Vec3f &other) const
+	{
+		return Vec3f(x * other.x, y * other.y, z * other.z);
+	}
+
+	constexpr Vec3f operator* (float scale) const
+	{
+		return Vec3f(x * scale, y * scale, z * scale);
+	}
+
+	Vec3f& operator+= (const Vec3f &other)
+	{
+		x += other.x;
+		y += other.y;
+		z += other.z;
+		return *this;
+	}
+
+	Vec3f& operator-= (const Vec3f &other)
+	{
+		x -= other.x;
+		y -= other.y;
+		z -= other.z;
+		return *this;
+	}
 
-	Vec3f negate(); //finds the inverse of the vector
+	Vec3f& operator*= (const Vec3f &other)
+	{
+		x *= other.x;
+		y *= other.y;
+		z *= other.z;
+		return *this;
+	}
+
+	Vec3f& operator*= (float scale)
+	{
+		x *= scale;
+		y *= scale;
+		z *= scale;
+		return *this;
+	}
+
+	constexpr bool operator == (const Vec3f &other) const
+	{
+		return x == other.x && y == other.y && z == other.z;
+	}
+
+	constexpr bool operator != (const Vec3f &other) const
+	{
+		return !(*this == other);
+	}
+
+	constexpr bool operator <= (const Vec3f &other) const
+	{
+		return x <= other.x && y <= other.y && z <= other.z;
+	}
+
+	float magnitude() const
+	{
+		return sqrtf((x * x) + (y * y) + (z * z));
+	}
+
+	Vec3f normalize() const
+	{
+		float mag = magnitude();
+		if (mag != 0.0f)
+		{
+			return *this * (1.0f / mag);
+		}
+		return Vec3f();
+	}
+
+	constexpr Vec3f square() const
+	{
+		return Vec3f((x * x), (y * y), (z * z));
+	}
+
+	constexpr float dot(const Vec3f &other) const	//dot product
+	{
+		return (x * other.x) + (y * other.y) + (z * other.z);
+	}
+
+	constexpr Vec3f cross(const Vec3f &other) const	//cross product
+	{
+		return Vec3f((y * other.z) - (other.y * z), (z * other.x) - (other.z * x), (x * other.y) - (other.x * y));
+	}
+
+	Vec3f dirVec(const Vec3f &other) const		//direction of a vector between two points
+	{
+		return (*this - other).normalize();
+	}
+
+	constexpr Vec3f negate() const //finds the inverse of the vector
+	{
+		return Vec3f(-x, -y, -z);
+	}
 
 	union
 	{
@@ -43,9 +138,6 @@ public:
 		struct { float r, g, b; };
 		float v[3];
 	};
-
-//private:
-//	float v[3];
 };
 
 std::ostream &operator<<(std::ostream &os, const Vec3f &v);
@@ -477,43 +569,18 @@ inline lerpClass LERP(lerpClass v0, lerpClass v1, float t)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // Returns a random number between 0 - 1
-static const float GetRandomNum()
+inline float GetRandomNum()
 {
 	return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
 }
 
-static float Clamp(float n, float lower, float upper)
+inline float Clamp(float n, float lower, float upper)
 {
 	return std::max(lower, std::min(n, upper));
 }
 
-static Vec3f GetRandomUnitVecInSphere()
-{
-	Vec3f p;
-	do
-	{
-		p = Vec3f(GetRandomNum(), GetRandomNum(), GetRandomNum()) * 2.0f - Vec3f(1, 1, 1);
-	} while (p.x * p.x + p.y * p.y + p.z * p.z >= 1.0f);
-	return p;
-}
-
 static Vec3f Reflect(Vec3f v, Vec3f n)
 {
 	return v - (n * v.dot(n) * 2);
 }
 
-static Vec3f ACESFilmToneMapper(Vec3f col)
-{
-	float A = 2.51f;
-	float B = 0.03f;
-	float C = 2.43f;
-	float D = 0.59f;
-	float E = 0.14f;
-
-	float r = (col.r * (A * col.r + B)) / (col.r * (C * col.r + D) + E);
-	float g = (col.g * (A * col.g + B)) / (col.g * (C * col.g + D) + E);
-	float b = (col.b * (A * col.b + B)) / (col.b * (C * col.b + D) + E);
-
-	return Vec3f(Clamp(r, 0.0f, 1.0f), Clamp(g, 0.0f, 1.0f), Clamp(b, 0.0f, 1.0f));
-}
-
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Comment out to compile all the counters and timers away
+#define PROFILING
+
+enum ProfileCounter
+{
+	enPrimaryRays,
+	enBounceRays,
+	enShadowRays,
+	enBVHNodeVisits,
+	enSphereTests,
+	enSamples,
+	enNumOfProfileCounters
+};
+
+static const char* g_profileCounterNames[enNumOfProfileCounters] = { "primaryRays", "bounceRays", "shadowRays", "bvhNodeVisits", "sphereTests", "samples" };
+
+// A timed span of work on one thread, e.g. a render stage or a tile
+struct ProfileEvent
+{
+	const char* m_name;
+	int64_t m_startMicroseconds;
+	int64_t m_durationMicroseconds;
+	int m_argument; // Tile index, or -1
+};
+
+// What one thread has counted and timed. Only its own thread writes to it, so nothing is locked or shared until
+// the results are merged at the end.
+struct ProfileThreadData
+{
+	uint64_t m_counters[enNumOfProfileCounters];
+	std::vector<ProfileEvent> m_events;
+	int m_threadId;
+};
+
+class Profiler
+{
+public:
+	Profiler()
+		:m_start(std::chrono::steady_clock::now())
+		,m_isRecordingEvents(false)
+	{
+	}
+
+	// Events pile up for as long as the program runs, so they are only kept when something is going to read them.
+	// The counters are a fixed few per thread and are always kept.
+	void SetRecordingEvents(bool isRecordingEvents)
+	{
+		m_isRecordingEvents.store(isRecordingEvents, std::memory_order_relaxed);
+	}
+
+	bool IsRecordingEvents() const
+	{
+		return m_isRecordingEvents.load(std::memory_order_relaxed);
+	}
+
+	ProfileThreadData* RegisterThread()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_threads.push_back(std::unique_ptr<ProfileThreadData>(new ProfileThreadData()));
+		ProfileThreadData* pData = m_threads.back().get();
+		for (uint64_t& rCounter : pData->m_counters)
+		{
+			rCounter = 0;
+		}
+		pData->m_threadId = static_cast<int>(m_threads.size()) - 1;
+		return pData;
+	}
+
+	// Zeroes the counters and drops the events of every thread. Only safe while no other thread is profiling.
+	void Reset()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const std::unique_ptr<ProfileThreadData>& pData : m_threads)
+		{
+			for (uint64_t& rCounter : pData->m_counters)
+			{
+				rCounter = 0;
+			}
+			pData->m_events.clear();
+		}
+	}
+
+	int64_t GetMicroseconds() const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+	}
+
+	// Counters summed over every thread, returns how many threads there are. Only meaningful once the threads have
+	// finished their work.
+	int GetCounters(uint64_t (&rCounters)[enNumOfProfileCounters])
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (int i = 0; i < enNumOfProfileCounters; i++)
+		{
+			rCounters[i] = 0;
+			for (const std::unique_ptr<ProfileThreadData>& pData : m_threads)
+			{
+				rCounters[i] += pData->m_counters[i];
+			}
+		}
+		return static_cast<int>(m_threads.size());
+	}
+
+	// Milliseconds spent in each named event, summed over every thread
+	void GetEventTotals(std::map<std::string, double>& rTotals, std::map<std::string, int>& rCounts)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const std::unique_ptr<ProfileThreadData>& pData : m_threads)
+		{
+			for (const ProfileEvent& event : pData->m_events)
+			{
+				rTotals[event.m_name] += event.m_durationMicroseconds / 1000.0;
+				rCounts[event.m_name]++;
+			}
+		}
+	}
+
+	// Totals of every counter and event as a JSON object
+	bool WriteJson(const char* fileName)
+	{
+		uint64_t counters[enNumOfProfileCounters];
+		const int numOfThreads = GetCounters(counters);
+		std::map<std::string, double> totals;
+		std::map<std::string, int> counts;
+		GetEventTotals(totals, counts);
+		const double elapsedSeconds = GetMicroseconds() / 1000000.0;
+
+		FILE* pFile = fopen(fileName, "w");
+		if (pFile == nullptr)
+		{
+			std::cout << "Failed to open " << fileName << " for writing" << std::endl;
+			return false;
+		}
+
+		const uint64_t totalRays = counters[enPrimaryRays] + counters[enBounceRays] + counters[enShadowRays];
+		fprintf(pFile, "{\n\t\"elapsedSeconds\": %.6f,\n\t\"threads\": %d,\n\t\"counters\": {\n", elapsedSeconds, numOfThreads);
+		for (int i = 0; i < enNumOfProfileCounters; i++)
+		{
+			fprintf(pFile, "\t\t\"%s\": %llu,\n", g_profileCounterNames[i], static_cast<unsigned long long>(counters[i]));
+		}
+		fprintf(pFile, "\t\t\"totalRays\": %llu\n\t},\n\t\"events\": {\n", static_cast<unsigned long long>(totalRays));
+
+		size_t eventIndex = 0;
+		for (const std::pair<const std::string, double>& total : totals)
+		{
+			const bool isLast = ++eventIndex == totals.size();
+			fprintf(pFile, "\t\t\"%s\": { \"count\": %d, \"totalMs\": %.3f }%s\n", total.first.c_str(), counts[total.first], total.second, isLast ? "" : ",");
+		}
+		fprintf(pFile, "\t}\n}\n");
+
+		const bool isWritten = ferror(pFile) == 0;
+		fclose(pFile);
+		return isWritten;
+	}
+
+	// Every event in the Chrome trace event format, for chrome://tracing or Perfetto
+	bool WriteChromeTrace(const char* fileName)
+	{
+		FILE* pFile = fopen(fileName, "w");
+		if (pFile == nullptr)
+		{
+			std::cout << "Failed to open " << fileName << " for writing" << std::endl;
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		fprintf(pFile, "{\"traceEvents\":[\n");
+		bool isFirst = true;
+		for (const std::unique_ptr<ProfileThreadData>& pData : m_threads)
+		{
+			for (const ProfileEvent& event : pData->m_events)
+			{
+				fprintf(pFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%lld,\"dur\":%lld", isFirst ? "" : ",\n",
+					event.m_name, pData->m_threadId, static_cast<long long>(event.m_startMicroseconds), static_cast<long long>(event.m_durationMicroseconds));
+				if (event.m_argument >= 0)
+				{
+					fprintf(pFile, ",\"args\":{\"index\":%d}", event.m_argument);
+				}
+				fprintf(pFile, "}");
+				isFirst = false;
+			}
+		}
+		fprintf(pFile, "\n]}\n");
+
+		const bool isWritten = ferror(pFile) == 0;
+		fclose(pFile);
+		return isWritten;
+	}
+
+private:
+	std::chrono::steady_clock::time_point m_start;
+	std::mutex m_mutex;
+	std::vector<std::unique_ptr<ProfileThreadData>> m_threads; // Outlive their threads, so the results can be read after a thread pool is gone
+	std::atomic<bool> m_isRecordingEvents;
+};
+
+// inline rather than static so every file shares the one profiler
+inline Profiler& GetProfiler()
+{
+	static Profiler s_profiler;
+	return s_profiler;
+}
+
+inline ProfileThreadData& GetProfileThreadData()
+{
+	thread_local ProfileThreadData* t_pData = GetProfiler().RegisterThread();
+	return *t_pData;
+}
+
+// Times the scope it lives in and records it as an event of the current thread, if the profiler is recording events
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name, int argument = -1)
+		:m_name(name)
+		,m_argument(argument)
+		,m_isRecording(GetProfiler().IsRecordingEvents())
+		,m_startMicroseconds(m_isRecording ? GetProfiler().GetMicroseconds() : 0)
+	{
+	}
+
+	~ProfileScope()
+	{
+		if (!m_isRecording)
+		{
+			return;
+		}
+
+		ProfileEvent event;
+		event.m_name = m_name;
+		event.m_startMicroseconds = m_startMicroseconds;
+		event.m_durationMicroseconds = GetProfiler().GetMicroseconds() - m_startMicroseconds;
+		event.m_argument = m_argument;
+		GetProfileThreadData().m_events.push_back(event);
+	}
+
+private:
+	const char* m_name;
+	int m_argument;
+	bool m_isRecording;
+	int64_t m_startMicroseconds;
+};
+
+#ifdef PROFILING
+#define PROFILE_COUNT(counter, amount) (GetProfileThreadData().m_counters[counter] += (amount))
+#define PROFILE_SCOPE(name) ProfileScope profileScope(name)
+#define PROFILE_SCOPE_INDEX(name, index) ProfileScope profileScope(name, index)
+#else
+#define PROFILE_COUNT(counter, amount)
+#define PROFILE_SCOPE(name)
+#define PROFILE_SCOPE_INDEX(name, index)
+#endif // PROFILING
+
+// Counts the work of one BVH traversal in locals and adds it to the thread's counters once, when it goes out of
+// scope, rather than touching thread local storage for every node
+struct TraversalCounts
+{
+	TraversalCounts()
+		:m_nodeVisits(0)
+		,m_sphereTests(0)
+	{
+	}
+
+	~TraversalCounts()
+	{
+		PROFILE_COUNT(enBVHNodeVisits, m_nodeVisits);
+		PROFILE_COUNT(enSphereTests, m_sphereTests);
+	}
+
+	uint32_t m_nodeVisits;
+	uint32_t m_sphereTests;
+};
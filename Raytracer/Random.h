@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// PCG32 random number generator. Each render thread owns its own instance, so unlike rand() there is no
+// shared state to lock, and seeding it per pixel makes a render repeatable for a given seed.
+class Random
+{
+public:
+	Random(uint64_t seed = 0, uint64_t stream = 0)
+	{
+		Seed(seed, stream);
+	}
+
+	void Seed(uint64_t seed, uint64_t stream = 0)
+	{
+		m_state = 0u;
+		m_increment = (stream << 1u) | 1u;
+		NextUInt();
+		m_state += seed;
+		NextUInt();
+	}
+
+	uint32_t NextUInt()
+	{
+		uint64_t oldState = m_state;
+		m_state = oldState * 6364136223846793005ULL + m_increment;
+		uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+		uint32_t rotation = static_cast<uint32_t>(oldState >> 59u);
+		return (xorShifted >> rotation) | (xorShifted << ((0u - rotation) & 31u));
+	}
+
+	// Returns a random number between 0 - 1, excluding 1
+	float NextFloat()
+	{
+		return static_cast<float>(NextUInt() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t m_state;
+	uint64_t m_increment;
+};
+
+// Mixes values into a well distributed seed (splitmix64 finalizer)
+inline uint64_t HashSeed(uint64_t a, uint64_t b)
+{
+	uint64_t z = a + 0x9E3779B97F4A7C15ULL * (b + 1u);
+	z = (z ^ (z >> 30u)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27u)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31u);
+}
@@ -5,25 +5,25 @@
 class Ray
 {
 public:
-	Ray() {}
+	constexpr Ray() {}
 
-	Ray(Vec3f origin, Vec3f direction)
+	constexpr Ray(const Vec3f& origin, const Vec3f& direction)
+		:m_origin(origin)
+		,m_direction(direction)
 	{
-		m_origin = origin;
-		m_direction = direction;
 	}
 
-	Vec3f GetOrigin()
+	const Vec3f& GetOrigin() const
 	{
 		return m_origin;
 	}
 
-	Vec3f GetDirection()
+	const Vec3f& GetDirection() const
 	{
 		return m_direction;
 	}
 
-	Vec3f GetPointAtParameter(float t)
+	constexpr Vec3f GetPointAtParameter(float t) const
 	{
 		return m_origin + (m_direction * t);
 	}
@@ -32,4 +32,3 @@ private:
 	Vec3f m_origin;
 	Vec3f m_direction;
 };
-
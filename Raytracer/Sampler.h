@@ -0,0 +1,484 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "MathClass.h"
+#include "Random.h"
+#include "Sampling.h"
+
+// Side of the tiled blue noise texture, a power of 2
+#define BLUE_NOISE_SIZE 64
+
+// Dimensions the Halton sampler has a prime base for, anything past them takes random numbers
+#define HALTON_MAX_DIMENSIONS 32
+
+// Largest float below 1
+#define SAMPLE_ONE_MINUS_EPSILON 0.99999994f
+
+enum SamplerType
+{
+	enRandomSampler,     // Independent random numbers, the same ones the renderer has always used
+	enStratifiedSampler, // Correlated multi-jittered, one stratum per sample of the pixel
+	enHaltonSampler,     // Halton sequence with its digits scrambled per pixel
+	enSobolSampler,      // Owen scrambled Sobol pairs, scrambled per pixel
+	enBlueNoiseSampler,  // Sobol pairs shared by every pixel, rotated per pixel by a blue noise texture
+	enNumOfSamplerTypes
+};
+
+const char* const g_samplerTypeNames[enNumOfSamplerTypes] = { "random", "stratified", "halton", "sobol", "bluenoise" };
+
+inline uint32_t ReverseBits(uint32_t x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+// Owen scrambling of the bits of x, as a hash that only lets each bit be changed by the bits above it (Laine and
+// Karras' permutation run on the reversed bits, with the constants from Burley's "Practical Hash-based Owen
+// Scrambling"). Keeps the stratification of a Sobol sequence while making every seed a different sequence.
+inline uint32_t OwenScramble(uint32_t x, uint32_t seed)
+{
+	x = ReverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return ReverseBits(x);
+}
+
+// First two dimensions of the Sobol sequence, which together are a (0, 2) sequence: every power of 2 run of points
+// has exactly one point in each of the equal area rectangles it could
+inline uint32_t SobolFirstDimension(uint32_t index)
+{
+	return ReverseBits(index);
+}
+
+// The second dimension is the index times a fixed bit matrix, so it is built a byte of the index at a time from
+// tables of what each byte value contributes
+inline uint32_t SobolSecondDimension(uint32_t index)
+{
+	struct ByteTables
+	{
+		ByteTables()
+		{
+			uint32_t directions[32];
+			directions[0] = 1u << 31;
+			for (int bit = 1; bit < 32; bit++)
+			{
+				directions[bit] = directions[bit - 1] ^ (directions[bit - 1] >> 1);
+			}
+			for (int byte = 0; byte < 4; byte++)
+			{
+				for (int value = 0; value < 256; value++)
+				{
+					uint32_t result = 0;
+					for (int bit = 0; bit < 8; bit++)
+					{
+						if (value & (1 << bit))
+						{
+							result ^= directions[byte * 8 + bit];
+						}
+					}
+					m_values[byte][value] = result;
+				}
+			}
+		}
+
+		uint32_t m_values[4][256];
+	};
+	static const ByteTables s_tables;
+	return s_tables.m_values[0][index & 0xff] ^ s_tables.m_values[1][(index >> 8) & 0xff] ^ s_tables.m_values[2][(index >> 16) & 0xff] ^ s_tables.m_values[3][index >> 24];
+}
+
+inline float UIntToUnitFloat(uint32_t x)
+{
+	return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Random permutation of [0, count) picked by seed, from Kensler's "Correlated Multi-Jittered Sampling"
+inline uint32_t PermuteIndex(uint32_t i, uint32_t count, uint32_t seed)
+{
+	uint32_t mask = count - 1;
+	mask |= mask >> 1;
+	mask |= mask >> 2;
+	mask |= mask >> 4;
+	mask |= mask >> 8;
+	mask |= mask >> 16;
+	do
+	{
+		i ^= seed;
+		i *= 0xe170893du;
+		i ^= seed >> 16;
+		i ^= (i & mask) >> 4;
+		i ^= seed >> 8;
+		i *= 0x0929eb3fu;
+		i ^= seed >> 23;
+		i ^= (i & mask) >> 1;
+		i *= 1 | seed >> 27;
+		i *= 0x6935fa69u;
+		i ^= (i & mask) >> 11;
+		i *= 0x74dcb303u;
+		i ^= (i & mask) >> 2;
+		i *= 0x9e501cc3u;
+		i ^= (i & mask) >> 2;
+		i *= 0xc860a3dfu;
+		i &= mask;
+		i ^= i >> 5;
+	} while (i >= count);
+	return (i + seed) % count;
+}
+
+// Hashes i and seed to a float in [0, 1)
+inline float HashToUnitFloat(uint32_t i, uint32_t seed)
+{
+	return UIntToUnitFloat(static_cast<uint32_t>(HashSeed(seed, i)));
+}
+
+// Digits of index in base, mirrored around the decimal point, with every digit put through a random permutation
+// picked by seed and the digits below it. Permuting the digits keeps the stratification of the Halton sequence but
+// breaks up the lines its large bases otherwise form at low sample counts.
+inline float ScrambledRadicalInverse(uint32_t base, uint32_t index, uint32_t seed)
+{
+	const double inverseBase = 1.0 / base;
+	double inverseBaseN = 1.0;
+	uint64_t reversedDigits = 0;
+	while (index != 0)
+	{
+		const uint32_t next = index / base;
+		const uint32_t digit = PermuteIndex(index - next * base, base, static_cast<uint32_t>(HashSeed(seed, reversedDigits)));
+		reversedDigits = reversedDigits * base + digit;
+		inverseBaseN *= inverseBase;
+		index = next;
+	}
+	// The leading zeros of index would be scrambled as well, which comes to a uniform random offset below the last digit
+	const double tail = HashToUnitFloat(static_cast<uint32_t>(reversedDigits), seed);
+	return std::min(static_cast<float>((reversedDigits + tail) * inverseBaseN), SAMPLE_ONE_MINUS_EPSILON);
+}
+
+// Adds offset to u and wraps it back into [0, 1), a Cranley-Patterson rotation
+inline float RotateSample(float u, float offset)
+{
+	const float rotated = u + offset;
+	return rotated >= 1.0f ? std::max(0.0f, rotated - 1.0f) : rotated;
+}
+
+// Ranks every texel of a size by size tileable texture with the void and cluster method (Ulichney 1993), and returns
+// them as values in [0, 1). Any threshold of the texture picks texels that are spread evenly with no clumps, so
+// neighbouring pixels that read it get very different values, and the error they leave is high frequency noise the
+// eye averages away.
+inline std::vector<float> MakeBlueNoise(int size, uint64_t seed)
+{
+	const int numOfTexels = size * size;
+	const int mask = size - 1;
+
+	// Gaussian falloff with wrapped distances, so the texture tiles
+	const float sigma = 1.5f;
+	std::vector<float> falloff(numOfTexels);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			const int dx = std::min(x, size - x);
+			const int dy = std::min(y, size - y);
+			falloff[x + y * size] = expf(-static_cast<float>(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+		}
+	}
+
+	std::vector<bool> isSet(numOfTexels, false);
+	std::vector<float> energy(numOfTexels, 0.0f);
+	auto toggle = [&](int texel)
+	{
+		const float sign = isSet[texel] ? -1.0f : 1.0f;
+		isSet[texel] = !isSet[texel];
+		const int texelX = texel & mask;
+		const int texelY = texel / size;
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				energy[x + y * size] += sign * falloff[((x - texelX) & mask) + ((y - texelY) & mask) * size];
+			}
+		}
+	};
+	// Tightest cluster is the set texel with the most energy, largest void the clear one with the least
+	auto findTexel = [&](bool isTightestCluster)
+	{
+		int best = -1;
+		for (int texel = 0; texel < numOfTexels; texel++)
+		{
+			if (isSet[texel] == isTightestCluster && (best < 0 || (isTightestCluster ? energy[texel] > energy[best] : energy[texel] < energy[best])))
+			{
+				best = texel;
+			}
+		}
+		return best;
+	};
+
+	// Random initial pattern, relaxed by moving the tightest cluster into the largest void until that stops changing it
+	Random random(seed);
+	const int numOfInitialTexels = numOfTexels / 10;
+	for (int i = 0; i < numOfInitialTexels; )
+	{
+		const int texel = static_cast<int>(random.NextUInt() % numOfTexels);
+		if (!isSet[texel])
+		{
+			toggle(texel);
+			i++;
+		}
+	}
+	for (;;)
+	{
+		const int cluster = findTexel(true);
+		toggle(cluster);
+		const int largestVoid = findTexel(false);
+		toggle(largestVoid);
+		if (largestVoid == cluster)
+		{
+			break;
+		}
+	}
+	const std::vector<bool> initialPattern = isSet;
+	const std::vector<float> initialEnergy = energy;
+
+	// Texels of the initial pattern are ranked below it by taking out clusters, the rest above it by filling voids
+	std::vector<int> ranks(numOfTexels, 0);
+	for (int rank = numOfInitialTexels - 1; rank >= 0; rank--)
+	{
+		const int cluster = findTexel(true);
+		toggle(cluster);
+		ranks[cluster] = rank;
+	}
+	isSet = initialPattern;
+	energy = initialEnergy;
+	for (int rank = numOfInitialTexels; rank < numOfTexels; rank++)
+	{
+		const int largestVoid = findTexel(false);
+		toggle(largestVoid);
+		ranks[largestVoid] = rank;
+	}
+
+	std::vector<float> texture(numOfTexels);
+	for (int texel = 0; texel < numOfTexels; texel++)
+	{
+		texture[texel] = (ranks[texel] + 0.5f) / numOfTexels;
+	}
+	return texture;
+}
+
+// What every Sampler of a render shares
+class SampleSequence
+{
+public:
+	void Setup(SamplerType type, int numOfSamplesPerPixel, uint64_t seed)
+	{
+		m_type = type;
+		m_numOfSamplesPerPixel = std::max(1, numOfSamplesPerPixel);
+		m_seed = static_cast<uint32_t>(HashSeed(seed, 0x5a3c));
+		if (type == enBlueNoiseSampler && m_blueNoise.empty())
+		{
+			m_blueNoise = MakeBlueNoise(BLUE_NOISE_SIZE, 1);
+		}
+	}
+
+	SamplerType GetType() const
+	{
+		return m_type;
+	}
+
+	int GetNumOfSamplesPerPixel() const
+	{
+		return m_numOfSamplesPerPixel;
+	}
+
+	uint32_t GetSeed() const
+	{
+		return m_seed;
+	}
+
+	// Blue noise value of pixel (x, y), with each dimension reading the texture from its own offset
+	float GetBlueNoise(int x, int y, int dimension) const
+	{
+		const uint32_t offset = static_cast<uint32_t>(HashSeed(0xb1e, dimension));
+		const int texelX = (x + static_cast<int>(offset)) & (BLUE_NOISE_SIZE - 1);
+		const int texelY = (y + static_cast<int>(offset >> 16)) & (BLUE_NOISE_SIZE - 1);
+		return m_blueNoise[texelX + texelY * BLUE_NOISE_SIZE];
+	}
+
+private:
+	SamplerType m_type = enRandomSampler;
+	int m_numOfSamplesPerPixel = 1;
+	uint32_t m_seed = 0;
+	std::vector<float> m_blueNoise;
+};
+
+// Sample numbers for one path, picked by pixel, sample and dimension. Every call takes the next dimensions, so a
+// path has to ask for its numbers in the same order however it is traced. Random choices that gain nothing from
+// being spread out, like which light to sample or Russian roulette, come from GetRandom instead so they don't use
+// up dimensions.
+class Sampler
+{
+public:
+	// Only there so samplers can be kept in arrays, has to be assigned a real one before use
+	Sampler()
+		:m_pSequence(nullptr)
+		,m_pixelSeed(0)
+		,m_x(0)
+		,m_y(0)
+		,m_sampleIndex(0)
+		,m_dimension(0)
+	{
+	}
+
+	Sampler(const SampleSequence& sequence, int x, int y, uint64_t pixelSeed, int sampleIndex)
+		:m_pSequence(&sequence)
+		,m_random(HashSeed(pixelSeed, sampleIndex))
+		,m_pixelSeed(static_cast<uint32_t>(pixelSeed ^ (pixelSeed >> 32)))
+		,m_x(x)
+		,m_y(y)
+		,m_sampleIndex(static_cast<uint32_t>(sampleIndex))
+		,m_dimension(0)
+	{
+	}
+
+	float Get1D()
+	{
+		float u = 0.0f;
+		float v = 0.0f;
+		GetSample(1, u, v);
+		return u;
+	}
+
+	void Get2D(float& rU, float& rV)
+	{
+		GetSample(2, rU, rV);
+	}
+
+	// Uniformly distributed point inside the unit sphere, 3 dimensions
+	Vec3f GetPointInUnitSphere()
+	{
+		float u = 0.0f;
+		float v = 0.0f;
+		Get2D(u, v);
+		return SampleUnitBall(u, v, Get1D());
+	}
+
+	// Uniformly distributed point inside the unit disk on the z = 0 plane, 2 dimensions
+	Vec3f GetPointInUnitDisk()
+	{
+		float u = 0.0f;
+		float v = 0.0f;
+		Get2D(u, v);
+		float x = 0.0f;
+		float y = 0.0f;
+		SampleConcentricDisk(u, v, x, y);
+		return Vec3f(x, y, 0.0f);
+	}
+
+	// Cosine weighted direction around the unit normal, 2 dimensions
+	Vec3f GetCosineDirection(const Vec3f& normal)
+	{
+		float u = 0.0f;
+		float v = 0.0f;
+		Get2D(u, v);
+		return SampleCosineHemisphere(u, v, normal);
+	}
+
+	Random& GetRandom()
+	{
+		return m_random;
+	}
+
+private:
+	// Fills rU, and rV for 2 dimensions, from the next dimensions of the sequence
+	void GetSample(int numOfDimensions, float& rU, float& rV)
+	{
+		const int dimension = m_dimension;
+		m_dimension += numOfDimensions;
+		const uint32_t dimensionSeed = static_cast<uint32_t>(HashSeed(m_pixelSeed, dimension));
+
+		switch (m_pSequence->GetType())
+		{
+		case enRandomSampler:
+			rU = m_random.NextFloat();
+			rV = numOfDimensions == 2 ? m_random.NextFloat() : 0.0f;
+			return;
+		case enStratifiedSampler:
+		{
+			// Kensler's correlated multi-jittering, which works for any number of samples
+			const uint32_t numOfSamples = static_cast<uint32_t>(m_pSequence->GetNumOfSamplesPerPixel());
+			const uint32_t seed = dimensionSeed ^ static_cast<uint32_t>(HashSeed(m_sampleIndex / numOfSamples, 0));
+			const uint32_t sample = PermuteIndex(m_sampleIndex % numOfSamples, numOfSamples, seed * 0x51633e2du);
+			if (numOfDimensions == 1)
+			{
+				rU = std::min((sample + HashToUnitFloat(sample, seed * 0x967a889bu)) / numOfSamples, SAMPLE_ONE_MINUS_EPSILON);
+				rV = 0.0f;
+				return;
+			}
+			const uint32_t columns = std::max(1u, static_cast<uint32_t>(sqrtf(static_cast<float>(numOfSamples))));
+			const uint32_t rows = (numOfSamples + columns - 1) / columns;
+			const uint32_t column = PermuteIndex(sample % columns, columns, seed * 0x68bc21ebu);
+			const uint32_t row = PermuteIndex(sample / columns, rows, seed * 0x02e5be93u);
+			const float jitterU = HashToUnitFloat(sample, seed * 0x967a889bu);
+			const float jitterV = HashToUnitFloat(sample, seed * 0x368cc8b7u);
+			rU = std::min((column + (row + jitterU) / rows) / columns, SAMPLE_ONE_MINUS_EPSILON);
+			rV = std::min((sample + jitterV) / numOfSamples, SAMPLE_ONE_MINUS_EPSILON);
+			return;
+		}
+		case enHaltonSampler:
+		{
+			static const uint32_t primes[HALTON_MAX_DIMENSIONS] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131 };
+			float* pValues[2] = { &rU, &rV };
+			rV = 0.0f;
+			for (int i = 0; i < numOfDimensions; i++)
+			{
+				if (dimension + i < HALTON_MAX_DIMENSIONS)
+				{
+					*pValues[i] = ScrambledRadicalInverse(primes[dimension + i], m_sampleIndex, static_cast<uint32_t>(HashSeed(m_pixelSeed, dimension + i)));
+				}
+				else
+				{
+					*pValues[i] = m_random.NextFloat();
+				}
+			}
+			return;
+		}
+		case enSobolSampler:
+		case enBlueNoiseSampler:
+		{
+			// Every pair of dimensions gets its own shuffle of the sample order and its own scramble. The blue noise
+			// sampler gives all pixels the same points and spreads them out with a blue noise rotation instead.
+			const bool isBlueNoise = m_pSequence->GetType() == enBlueNoiseSampler;
+			const uint32_t seed = isBlueNoise ? static_cast<uint32_t>(HashSeed(m_pSequence->GetSeed(), dimension)) : dimensionSeed;
+			const uint32_t index = OwenScramble(m_sampleIndex, seed);
+			rU = UIntToUnitFloat(OwenScramble(SobolFirstDimension(index), seed * 0x9e3779b9u));
+			rV = numOfDimensions == 2 ? UIntToUnitFloat(OwenScramble(SobolSecondDimension(index), seed * 0x85ebca6bu)) : 0.0f;
+			if (isBlueNoise)
+			{
+				rU = RotateSample(rU, m_pSequence->GetBlueNoise(m_x, m_y, dimension));
+				rV = numOfDimensions == 2 ? RotateSample(rV, m_pSequence->GetBlueNoise(m_x, m_y, dimension + 1)) : 0.0f;
+			}
+			return;
+		}
+		default:
+			rU = 0.0f;
+			rV = 0.0f;
+			return;
+		}
+	}
+
+	const SampleSequence* m_pSequence;
+	Random m_random;
+	uint32_t m_pixelSeed;
+	int m_x;
+	int m_y;
+	uint32_t m_sampleIndex;
+	int m_dimension;
+};
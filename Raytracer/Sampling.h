@@ -0,0 +1,304 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "MathClass.h"
+#include "Random.h"
+#include "Simd.h"
+
+// Maps from uniform numbers in [0, 1) to points in the unit disk, ball and hemisphere. Each is closed form with no
+// loops or branches, so every sample costs the same and the compiler can turn the selects into blends. The 8 wide
+// versions take and give arrays of 8 values, for packets of rays, and each lane gets what the single sample version
+// gives it up to rounding.
+
+// sin and cos of x for |x| <= pi / 4, from their Taylor series up to the terms below float precision
+inline void SinCosQuarterPi(float x, float& rSin, float& rCos)
+{
+	const float x2 = x * x;
+	rSin = x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f + x2 * (1.0f / 362880.0f)))));
+	rCos = 1.0f + x2 * (-1.0f / 2.0f + x2 * (1.0f / 24.0f + x2 * (-1.0f / 720.0f + x2 * (1.0f / 40320.0f))));
+}
+
+// Cube root of x >= 0. The bit pattern divided by 3 is a guess within 4%, and three Newton-Raphson steps take it to
+// float precision.
+inline float CubeRoot(float x)
+{
+	int32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	bits = static_cast<int32_t>(static_cast<float>(bits) * (1.0f / 3.0f)) + 0x2a5137a0;
+	float y;
+	memcpy(&y, &bits, sizeof(y));
+	for (int i = 0; i < 3; i++)
+	{
+		y = (y + y + x / (y * y)) * (1.0f / 3.0f);
+	}
+	return y;
+}
+
+// Shirley and Chiu's concentric mapping, which takes squares around the middle of [0, 1)^2 to circles so that
+// stratified samples stay stratified in the disk
+inline void SampleConcentricDisk(float u, float v, float& rX, float& rY)
+{
+	const float a = 2.0f * u - 1.0f;
+	const float b = 2.0f * v - 1.0f;
+	const bool isAlongA = fabsf(a) > fabsf(b);
+	const float radius = isAlongA ? a : b;
+	const float ratio = (isAlongA ? b : a) / (radius != 0.0f ? radius : 1.0f);
+	float sine;
+	float cosine;
+	SinCosQuarterPi(ratio * (PI / 4.0f), sine, cosine);
+	rX = radius * (isAlongA ? cosine : sine);
+	rY = radius * (isAlongA ? sine : cosine);
+}
+
+// Clarberg's equal area mapping of the square onto the sphere, which folds the square's corners over into the
+// lower hemisphere like an octahedron
+inline void SampleUnitSphereSurface(float u, float v, float& rX, float& rY, float& rZ)
+{
+	const float a = 2.0f * u - 1.0f;
+	const float b = 2.0f * v - 1.0f;
+	const float absA = fabsf(a);
+	const float absB = fabsf(b);
+	const float signedDistance = 1.0f - (absA + absB);
+	const float radius = 1.0f - fabsf(signedDistance);
+	const float ratio = (absB - absA) / (radius != 0.0f ? radius : 1.0f);
+	float sine;
+	float cosine;
+	SinCosQuarterPi(ratio * (PI / 4.0f), sine, cosine);
+	// The angle around the pole is ratio * pi / 4 + pi / 4
+	const float cosPhi = (cosine - sine) * 0.70710678f;
+	const float sinPhi = (cosine + sine) * 0.70710678f;
+	const float ringScale = radius * sqrtf(std::max(0.0f, 2.0f - radius * radius));
+	rX = copysignf(cosPhi, a) * ringScale;
+	rY = copysignf(sinPhi, b) * ringScale;
+	rZ = copysignf(1.0f - radius * radius, signedDistance);
+}
+
+// Uniformly distributed point inside the unit sphere, a direction from (u, v) and the cube root of w for the
+// distance from the middle
+inline Vec3f SampleUnitBall(float u, float v, float w)
+{
+	float x;
+	float y;
+	float z;
+	SampleUnitSphereSurface(u, v, x, y, z);
+	const float radius = CubeRoot(w);
+	return Vec3f(x * radius, y * radius, z * radius);
+}
+
+// Direction in the hemisphere around the unit normal with density proportional to the cosine to it, the bounce
+// direction of a Lambertian surface. A concentric disk point is lifted up onto the hemisphere and turned into a
+// frame around the normal built without branches (Duff et al., "Building an Orthonormal Basis, Revisited").
+inline Vec3f SampleCosineHemisphere(float u, float v, const Vec3f& normal)
+{
+	float x;
+	float y;
+	SampleConcentricDisk(u, v, x, y);
+	const float z = sqrtf(std::max(0.0f, 1.0f - x * x - y * y));
+
+	const float sign = copysignf(1.0f, normal.z);
+	const float a = -1.0f / (sign + normal.z);
+	const float b = normal.x * normal.y * a;
+	const Vec3f tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+	const Vec3f bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+	return tangent * x + bitangent * y + normal * z;
+}
+
+inline Vec3f GetRandomUnitVecInSphere(Random& rRandom)
+{
+	const float u = rRandom.NextFloat();
+	const float v = rRandom.NextFloat();
+	const float w = rRandom.NextFloat();
+	return SampleUnitBall(u, v, w);
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET_AVX2 static inline __m256 AbsAVX2(__m256 x)
+{
+	return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+}
+
+SIMD_TARGET_AVX2 static inline __m256 CopySignAVX2(__m256 magnitude, __m256 sign)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	return _mm256_or_ps(_mm256_andnot_ps(signMask, magnitude), _mm256_and_ps(signMask, sign));
+}
+
+SIMD_TARGET_AVX2 static inline void SinCosQuarterPiAVX2(__m256 x, __m256& rSin, __m256& rCos)
+{
+	const __m256 x2 = _mm256_mul_ps(x, x);
+	__m256 sine = _mm256_add_ps(_mm256_set1_ps(-1.0f / 5040.0f), _mm256_mul_ps(x2, _mm256_set1_ps(1.0f / 362880.0f)));
+	sine = _mm256_add_ps(_mm256_set1_ps(1.0f / 120.0f), _mm256_mul_ps(x2, sine));
+	sine = _mm256_add_ps(_mm256_set1_ps(-1.0f / 6.0f), _mm256_mul_ps(x2, sine));
+	rSin = _mm256_mul_ps(x, _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(x2, sine)));
+	__m256 cosine = _mm256_add_ps(_mm256_set1_ps(-1.0f / 720.0f), _mm256_mul_ps(x2, _mm256_set1_ps(1.0f / 40320.0f)));
+	cosine = _mm256_add_ps(_mm256_set1_ps(1.0f / 24.0f), _mm256_mul_ps(x2, cosine));
+	cosine = _mm256_add_ps(_mm256_set1_ps(-1.0f / 2.0f), _mm256_mul_ps(x2, cosine));
+	rCos = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(x2, cosine));
+}
+
+SIMD_TARGET_AVX2 static inline __m256 CubeRootAVX2(__m256 x)
+{
+	const __m256i bits = _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(x)), _mm256_set1_ps(1.0f / 3.0f))), _mm256_set1_epi32(0x2a5137a0));
+	__m256 y = _mm256_castsi256_ps(bits);
+	for (int i = 0; i < 3; i++)
+	{
+		y = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(y, y), _mm256_div_ps(x, _mm256_mul_ps(y, y))), _mm256_set1_ps(1.0f / 3.0f));
+	}
+	return y;
+}
+
+// Divides by radius, or by 1 where radius is 0
+SIMD_TARGET_AVX2 static inline __m256 SafeDivideAVX2(__m256 numerator, __m256 radius)
+{
+	const __m256 isZero = _mm256_cmp_ps(radius, _mm256_setzero_ps(), _CMP_EQ_OQ);
+	return _mm256_div_ps(numerator, _mm256_blendv_ps(radius, _mm256_set1_ps(1.0f), isZero));
+}
+
+SIMD_TARGET_AVX2 static inline void SampleConcentricDiskAVX2(__m256 u, __m256 v, __m256& rX, __m256& rY)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 a = _mm256_sub_ps(_mm256_mul_ps(two, u), one);
+	const __m256 b = _mm256_sub_ps(_mm256_mul_ps(two, v), one);
+	const __m256 isAlongA = _mm256_cmp_ps(AbsAVX2(a), AbsAVX2(b), _CMP_GT_OQ);
+	const __m256 radius = _mm256_blendv_ps(b, a, isAlongA);
+	const __m256 ratio = SafeDivideAVX2(_mm256_blendv_ps(a, b, isAlongA), radius);
+	__m256 sine;
+	__m256 cosine;
+	SinCosQuarterPiAVX2(_mm256_mul_ps(ratio, _mm256_set1_ps(PI / 4.0f)), sine, cosine);
+	rX = _mm256_mul_ps(radius, _mm256_blendv_ps(sine, cosine, isAlongA));
+	rY = _mm256_mul_ps(radius, _mm256_blendv_ps(cosine, sine, isAlongA));
+}
+
+SIMD_TARGET_AVX2 static inline void SampleUnitSphereSurfaceAVX2(__m256 u, __m256 v, __m256& rX, __m256& rY, __m256& rZ)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 a = _mm256_sub_ps(_mm256_mul_ps(two, u), one);
+	const __m256 b = _mm256_sub_ps(_mm256_mul_ps(two, v), one);
+	const __m256 absA = AbsAVX2(a);
+	const __m256 absB = AbsAVX2(b);
+	const __m256 signedDistance = _mm256_sub_ps(one, _mm256_add_ps(absA, absB));
+	const __m256 radius = _mm256_sub_ps(one, AbsAVX2(signedDistance));
+	const __m256 ratio = SafeDivideAVX2(_mm256_sub_ps(absB, absA), radius);
+	__m256 sine;
+	__m256 cosine;
+	SinCosQuarterPiAVX2(_mm256_mul_ps(ratio, _mm256_set1_ps(PI / 4.0f)), sine, cosine);
+	const __m256 cosPhi = _mm256_mul_ps(_mm256_sub_ps(cosine, sine), _mm256_set1_ps(0.70710678f));
+	const __m256 sinPhi = _mm256_mul_ps(_mm256_add_ps(cosine, sine), _mm256_set1_ps(0.70710678f));
+	const __m256 radiusSquared = _mm256_mul_ps(radius, radius);
+	const __m256 ringScale = _mm256_mul_ps(radius, _mm256_sqrt_ps(_mm256_max_ps(_mm256_setzero_ps(), _mm256_sub_ps(two, radiusSquared))));
+	rX = _mm256_mul_ps(CopySignAVX2(cosPhi, a), ringScale);
+	rY = _mm256_mul_ps(CopySignAVX2(sinPhi, b), ringScale);
+	rZ = CopySignAVX2(_mm256_sub_ps(one, radiusSquared), signedDistance);
+}
+
+SIMD_TARGET_AVX2 inline void SampleConcentricDisk8AVX2(const float* pU, const float* pV, float* pX, float* pY)
+{
+	__m256 x;
+	__m256 y;
+	SampleConcentricDiskAVX2(_mm256_loadu_ps(pU), _mm256_loadu_ps(pV), x, y);
+	_mm256_storeu_ps(pX, x);
+	_mm256_storeu_ps(pY, y);
+}
+
+SIMD_TARGET_AVX2 inline void SampleUnitBall8AVX2(const float* pU, const float* pV, const float* pW, float* pX, float* pY, float* pZ)
+{
+	__m256 x;
+	__m256 y;
+	__m256 z;
+	SampleUnitSphereSurfaceAVX2(_mm256_loadu_ps(pU), _mm256_loadu_ps(pV), x, y, z);
+	const __m256 radius = CubeRootAVX2(_mm256_loadu_ps(pW));
+	_mm256_storeu_ps(pX, _mm256_mul_ps(x, radius));
+	_mm256_storeu_ps(pY, _mm256_mul_ps(y, radius));
+	_mm256_storeu_ps(pZ, _mm256_mul_ps(z, radius));
+}
+
+SIMD_TARGET_AVX2 inline void SampleCosineHemisphere8AVX2(const float* pU, const float* pV, const float* pNormalX, const float* pNormalY, const float* pNormalZ, float* pX, float* pY, float* pZ)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	__m256 x;
+	__m256 y;
+	SampleConcentricDiskAVX2(_mm256_loadu_ps(pU), _mm256_loadu_ps(pV), x, y);
+	const __m256 z = _mm256_sqrt_ps(_mm256_max_ps(_mm256_setzero_ps(), _mm256_sub_ps(_mm256_sub_ps(one, _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y))));
+
+	const __m256 normalX = _mm256_loadu_ps(pNormalX);
+	const __m256 normalY = _mm256_loadu_ps(pNormalY);
+	const __m256 normalZ = _mm256_loadu_ps(pNormalZ);
+	const __m256 sign = CopySignAVX2(one, normalZ);
+	const __m256 a = _mm256_div_ps(_mm256_set1_ps(-1.0f), _mm256_add_ps(sign, normalZ));
+	const __m256 b = _mm256_mul_ps(_mm256_mul_ps(normalX, normalY), a);
+	const __m256 tangentX = _mm256_add_ps(one, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(sign, normalX), normalX), a));
+	const __m256 tangentY = _mm256_mul_ps(sign, b);
+	const __m256 tangentZ = _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), sign), normalX);
+	const __m256 bitangentY = _mm256_add_ps(sign, _mm256_mul_ps(_mm256_mul_ps(normalY, normalY), a));
+	const __m256 bitangentZ = _mm256_sub_ps(_mm256_setzero_ps(), normalY);
+
+	// tangent * x + bitangent * y + normal * z, summed in the same order as Vec3f
+	_mm256_storeu_ps(pX, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tangentX, x), _mm256_mul_ps(b, y)), _mm256_mul_ps(normalX, z)));
+	_mm256_storeu_ps(pY, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tangentY, x), _mm256_mul_ps(bitangentY, y)), _mm256_mul_ps(normalY, z)));
+	_mm256_storeu_ps(pZ, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tangentZ, x), _mm256_mul_ps(bitangentZ, y)), _mm256_mul_ps(normalZ, z)));
+}
+#endif // SIMD_X86
+
+inline bool HasSamplingAVX2()
+{
+	static const bool s_hasAVX2 = GetSupportedSimdLevel() == enAVX2;
+	return s_hasAVX2;
+}
+
+inline void SampleConcentricDisk8(const float* pU, const float* pV, float* pX, float* pY)
+{
+#if defined(SIMD_X86)
+	if (HasSamplingAVX2())
+	{
+		SampleConcentricDisk8AVX2(pU, pV, pX, pY);
+		return;
+	}
+#endif
+	for (int i = 0; i < 8; i++)
+	{
+		SampleConcentricDisk(pU[i], pV[i], pX[i], pY[i]);
+	}
+}
+
+inline void SampleUnitBall8(const float* pU, const float* pV, const float* pW, float* pX, float* pY, float* pZ)
+{
+#if defined(SIMD_X86)
+	if (HasSamplingAVX2())
+	{
+		SampleUnitBall8AVX2(pU, pV, pW, pX, pY, pZ);
+		return;
+	}
+#endif
+	for (int i = 0; i < 8; i++)
+	{
+		const Vec3f p = SampleUnitBall(pU[i], pV[i], pW[i]);
+		pX[i] = p.x;
+		pY[i] = p.y;
+		pZ[i] = p.z;
+	}
+}
+
+// Each lane has its own normal
+inline void SampleCosineHemisphere8(const float* pU, const float* pV, const float* pNormalX, const float* pNormalY, const float* pNormalZ, float* pX, float* pY, float* pZ)
+{
+#if defined(SIMD_X86)
+	if (HasSamplingAVX2())
+	{
+		SampleCosineHemisphere8AVX2(pU, pV, pNormalX, pNormalY, pNormalZ, pX, pY, pZ);
+		return;
+	}
+#endif
+	for (int i = 0; i < 8; i++)
+	{
+		const Vec3f direction = SampleCosineHemisphere(pU[i], pV[i], Vec3f(pNormalX[i], pNormalY[i], pNormalZ[i]));
+		pX[i] = direction.x;
+		pY[i] = direction.y;
+		pZ[i] = direction.z;
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <assert.h>
+#include <vector>
+
+#include "Materials.h"
+
+struct CameraSettings
+{
+	Vec3f m_lookFrom;
+	Vec3f m_lookAt;
+	Vec3f m_up;
+	float m_verticalFov; // Degrees
+	float m_aperture;
+	float m_focusDistance;
+};
+
+// Owns every hit object and material of a scene. Hit objects live by value in one array per type, so building a
+// scene costs a handful of allocations no matter how many spheres it has. Reserve has to be called with enough room
+// before adding anything, since m_hitObjects and m_lightObjects point into those arrays. Materials are kept in one
+// flat array and referred to by index.
+class Scene
+{
+public:
+	Scene()
+	{
+		m_camera.m_lookFrom = Vec3f(13.0f, 2.0f, 3.0f);
+		m_camera.m_lookAt = Vec3f(0.0f, 0.0f, 0.0f);
+		m_camera.m_up = Vec3f(0.0f, 1.0f, 0.0f);
+		m_camera.m_verticalFov = 20.0f;
+		m_camera.m_aperture = 0.1f;
+		m_camera.m_focusDistance = 10.0f;
+	}
+
+	// Copying would leave the pointers aimed at the other scene's arrays
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	void Reserve(int numOfSpheres, int numOfLightSpheres, int numOfLambertianDiffuses, int numOfMetals, int numOfEmmisives)
+	{
+		assert(m_hitObjects.empty() && m_materials.empty());
+		m_spheres.reserve(numOfSpheres);
+		m_lightSpheres.reserve(numOfLightSpheres);
+		m_hitObjects.reserve(numOfSpheres + numOfLightSpheres);
+		m_lightObjects.reserve(numOfLightSpheres);
+		m_materials.reserve(numOfLambertianDiffuses + numOfMetals + numOfEmmisives);
+	}
+
+	void Clear()
+	{
+		m_hitObjects.clear();
+		m_lightObjects.clear();
+		m_materials.clear();
+		m_spheres.clear();
+		m_lightSpheres.clear();
+	}
+
+	uint32_t AddLambertianDiffuse(const Vec3f& diffuse)
+	{
+		m_materials.push_back(MakeLambertianDiffuse(diffuse));
+		return static_cast<uint32_t>(m_materials.size() - 1);
+	}
+
+	uint32_t AddMetal(const Vec3f& diffuse, float fuzzyness)
+	{
+		m_materials.push_back(MakeMetal(diffuse, fuzzyness));
+		return static_cast<uint32_t>(m_materials.size() - 1);
+	}
+
+	uint32_t AddEmmisive(const Vec3f& diffuse, float exposure)
+	{
+		m_materials.push_back(MakeEmmisive(diffuse, exposure));
+		return static_cast<uint32_t>(m_materials.size() - 1);
+	}
+
+	Sphere* AddSphere(const Vec3f& center, float radius, uint32_t materialIndex)
+	{
+		assert(m_spheres.size() < m_spheres.capacity());
+		assert(materialIndex < m_materials.size());
+		m_spheres.push_back(Sphere(center, radius, materialIndex));
+		m_hitObjects.push_back(&m_spheres.back());
+		return &m_spheres.back();
+	}
+
+	LightSphere* AddLightSphere(const Vec3f& center, float radius, float lightRadius, float lightIntensity, uint32_t materialIndex)
+	{
+		assert(m_lightSpheres.size() < m_lightSpheres.capacity());
+		assert(materialIndex < m_materials.size());
+		m_lightSpheres.push_back(LightSphere(center, radius, lightRadius, lightIntensity, materialIndex));
+		m_hitObjects.push_back(&m_lightSpheres.back());
+		m_lightObjects.push_back(&m_lightSpheres.back());
+		return &m_lightSpheres.back();
+	}
+
+	std::vector<HitObject*> m_hitObjects;
+	std::vector<HitObject*> m_lightObjects;
+	std::vector<Material> m_materials; // In the order they were added, which is how scene files refer to them
+	CameraSettings m_camera;
+
+private:
+	std::vector<Sphere> m_spheres;
+	std::vector<LightSphere> m_lightSpheres;
+};
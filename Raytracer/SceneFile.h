@@ -0,0 +1,526 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_set>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Scene.h"
+
+/*
+Text scenes (.scene) have one entry per line, # starts a comment. Materials are numbered in the order they appear,
+and spheres refer to them by that number.
+
+camera <lookfrom x y z> <lookat x y z> <up x y z> <vertical fov> <aperture> <focus distance>
+lambertian <r g b>
+metal <r g b> <fuzzyness>
+emmisive <r g b> <exposure>
+sphere <center x y z> <radius> <material>
+light <center x y z> <radius> <light radius> <light intensity> <material>
+
+Numbers have to be finite, radii positive, light intensities not negative and material numbers whole. Binary scenes
+are checked the same way.
+
+Binary scenes (.sceneb) are a SceneFileHeader followed by the material records and then the sphere records, and
+are read straight out of a memory mapping.
+*/
+
+const char g_sceneFileMagic[4] = { 'R', 'T', 'S', 'B' };
+const uint32_t g_sceneFileVersion = 1;
+
+struct SceneFileHeader
+{
+	char m_magic[4];
+	uint32_t m_version;
+	uint32_t m_numOfMaterials;
+	uint32_t m_numOfSpheres;
+	float m_camera[12]; // lookfrom, lookat, up, vertical fov, aperture, focus distance
+};
+
+struct SceneFileMaterial
+{
+	uint32_t m_type; // MaterialType
+	float m_colour[3];
+	float m_parameter; // Fuzzyness for metals, exposure for emmisives
+};
+
+struct SceneFileSphere
+{
+	float m_center[3];
+	float m_radius;
+	float m_lightRadius;
+	float m_lightIntensity;
+	uint32_t m_materialIndex;
+	uint32_t m_isLight;
+};
+
+static bool IsSceneFileBinary(const char* fileName)
+{
+	const size_t length = strlen(fileName);
+	return length > 7 && strcmp(fileName + length - 7, ".sceneb") == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Moves to the start of the next line that isn't empty or a comment, returns false at the end of the file
+static bool NextSceneLine(const char*& rpText)
+{
+	while (*rpText != '\0')
+	{
+		while (*rpText == ' ' || *rpText == '\t' || *rpText == '\r' || *rpText == '\n')
+		{
+			rpText++;
+		}
+		if (*rpText == '#')
+		{
+			while (*rpText != '\0' && *rpText != '\n')
+			{
+				rpText++;
+			}
+			continue;
+		}
+		return *rpText != '\0';
+	}
+	return false;
+}
+
+static void SkipSceneLine(const char*& rpText)
+{
+	while (*rpText != '\0' && *rpText != '\n')
+	{
+		rpText++;
+	}
+}
+
+// Checks the keyword at the start of the line and moves past it when it matches
+static bool ReadSceneKeyword(const char*& rpText, const char* keyword)
+{
+	const size_t length = strlen(keyword);
+	if (strncmp(rpText, keyword, length) == 0 && (rpText[length] == ' ' || rpText[length] == '\t'))
+	{
+		rpText += length;
+		return true;
+	}
+	return false;
+}
+
+// Anything after the last value other than a comment fails, so a mistyped entry isn't half read
+static bool ReadSceneLineEnd(const char*& rpText)
+{
+	while (*rpText == ' ' || *rpText == '\t' || *rpText == '\r')
+	{
+		rpText++;
+	}
+	return *rpText == '\0' || *rpText == '\n' || *rpText == '#';
+}
+
+static bool AreSceneFloatsFinite(const float* pValues, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (!isfinite(pValues[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Fails on anything that isn't a finite number
+static bool ReadSceneFloats(const char*& rpText, float* pValues, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		char* pEnd = nullptr;
+		pValues[i] = strtof(rpText, &pEnd);
+		if (pEnd == rpText || !isfinite(pValues[i]))
+		{
+			return false;
+		}
+		rpText = pEnd;
+	}
+	return true;
+}
+
+// Fails on anything that isn't a whole number below numOfMaterials, so 1.5 isn't taken for material 1
+static bool ReadSceneMaterialIndex(const char*& rpText, size_t numOfMaterials, uint32_t& rMaterialIndex)
+{
+	char* pEnd = nullptr;
+	const long materialIndex = strtol(rpText, &pEnd, 10);
+	if (pEnd == rpText || (*pEnd != '\0' && *pEnd != ' ' && *pEnd != '\t' && *pEnd != '\r' && *pEnd != '\n' && *pEnd != '#'))
+	{
+		return false;
+	}
+	if (materialIndex < 0 || static_cast<unsigned long>(materialIndex) >= numOfMaterials)
+	{
+		return false;
+	}
+	rpText = pEnd;
+	rMaterialIndex = static_cast<uint32_t>(materialIndex);
+	return true;
+}
+
+static bool IsValidSceneRadius(float radius)
+{
+	return radius > 0.0f && isfinite(radius);
+}
+
+// The light sampler weights lights by intensity, so none can be negative
+static bool IsValidSceneLightIntensity(float lightIntensity)
+{
+	return lightIntensity >= 0.0f;
+}
+
+static bool LoadSceneText(const char* fileName, Scene& rScene)
+{
+	FILE* pFile = fopen(fileName, "rb");
+	if (pFile == nullptr)
+	{
+		std::cout << "Failed to open " << fileName << std::endl;
+		return false;
+	}
+	fseek(pFile, 0, SEEK_END);
+	const long fileSize = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+	if (fileSize < 0)
+	{
+		fclose(pFile);
+		std::cout << "Failed to read " << fileName << std::endl;
+		return false;
+	}
+	std::vector<char> text(fileSize + 1, '\0');
+	const size_t numOfBytesRead = fread(text.data(), 1, fileSize, pFile);
+	fclose(pFile);
+	if (numOfBytesRead != static_cast<size_t>(fileSize))
+	{
+		std::cout << "Failed to read " << fileName << std::endl;
+		return false;
+	}
+
+	// First pass only counts entries, so the scene can reserve exactly what it needs
+	int numOfSpheres = 0;
+	int numOfLightSpheres = 0;
+	int numOfLambertianDiffuses = 0;
+	int numOfMetals = 0;
+	int numOfEmmisives = 0;
+	const char* pText = text.data();
+	while (NextSceneLine(pText))
+	{
+		if (ReadSceneKeyword(pText, "sphere")) numOfSpheres++;
+		else if (ReadSceneKeyword(pText, "light")) numOfLightSpheres++;
+		else if (ReadSceneKeyword(pText, "lambertian")) numOfLambertianDiffuses++;
+		else if (ReadSceneKeyword(pText, "metal")) numOfMetals++;
+		else if (ReadSceneKeyword(pText, "emmisive")) numOfEmmisives++;
+		SkipSceneLine(pText);
+	}
+
+	rScene.Clear();
+	rScene.Reserve(numOfSpheres, numOfLightSpheres, numOfLambertianDiffuses, numOfMetals, numOfEmmisives);
+
+	int lineNumber = 0;
+	pText = text.data();
+	while (NextSceneLine(pText))
+	{
+		lineNumber++;
+		bool isValid = true;
+		float values[12];
+		uint32_t materialIndex = 0;
+		if (ReadSceneKeyword(pText, "camera"))
+		{
+			isValid = ReadSceneFloats(pText, values, 12);
+			if (isValid)
+			{
+				rScene.m_camera.m_lookFrom = Vec3f(values[0], values[1], values[2]);
+				rScene.m_camera.m_lookAt = Vec3f(values[3], values[4], values[5]);
+				rScene.m_camera.m_up = Vec3f(values[6], values[7], values[8]);
+				rScene.m_camera.m_verticalFov = values[9];
+				rScene.m_camera.m_aperture = values[10];
+				rScene.m_camera.m_focusDistance = values[11];
+			}
+		}
+		else if (ReadSceneKeyword(pText, "lambertian"))
+		{
+			isValid = ReadSceneFloats(pText, values, 3);
+			if (isValid)
+			{
+				rScene.AddLambertianDiffuse(Vec3f(values[0], values[1], values[2]));
+			}
+		}
+		else if (ReadSceneKeyword(pText, "metal"))
+		{
+			isValid = ReadSceneFloats(pText, values, 4);
+			if (isValid)
+			{
+				rScene.AddMetal(Vec3f(values[0], values[1], values[2]), values[3]);
+			}
+		}
+		else if (ReadSceneKeyword(pText, "emmisive"))
+		{
+			isValid = ReadSceneFloats(pText, values, 4);
+			if (isValid)
+			{
+				rScene.AddEmmisive(Vec3f(values[0], values[1], values[2]), values[3]);
+			}
+		}
+		else if (ReadSceneKeyword(pText, "sphere"))
+		{
+			isValid = ReadSceneFloats(pText, values, 4) && IsValidSceneRadius(values[3]) && ReadSceneMaterialIndex(pText, rScene.m_materials.size(), materialIndex);
+			if (isValid)
+			{
+				rScene.AddSphere(Vec3f(values[0], values[1], values[2]), values[3], materialIndex);
+			}
+		}
+		else if (ReadSceneKeyword(pText, "light"))
+		{
+			isValid = ReadSceneFloats(pText, values, 6) && IsValidSceneRadius(values[3]) && IsValidSceneRadius(values[4]) &&
+				IsValidSceneLightIntensity(values[5]) && ReadSceneMaterialIndex(pText, rScene.m_materials.size(), materialIndex);
+			if (isValid)
+			{
+				rScene.AddLightSphere(Vec3f(values[0], values[1], values[2]), values[3], values[4], values[5], materialIndex);
+			}
+		}
+		else
+		{
+			isValid = false;
+		}
+
+		if (!isValid || !ReadSceneLineEnd(pText))
+		{
+			std::cout << fileName << ": invalid entry " << lineNumber << std::endl;
+			rScene.Clear();
+			return false;
+		}
+		SkipSceneLine(pText);
+	}
+
+	return true;
+}
+
+static bool LoadSceneBinary(const char* fileName, Scene& rScene)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+	{
+		std::cout << "Failed to open " << fileName << std::endl;
+		return false;
+	}
+
+	const char* pData = static_cast<const char*>(file.GetData());
+	const SceneFileHeader* pHeader = reinterpret_cast<const SceneFileHeader*>(pData);
+	if (file.GetSize() < sizeof(SceneFileHeader) || memcmp(pHeader->m_magic, g_sceneFileMagic, 4) != 0 || pHeader->m_version != g_sceneFileVersion)
+	{
+		std::cout << fileName << " is not a binary scene" << std::endl;
+		return false;
+	}
+
+	// In 64 bits, as the counts times the record sizes can wrap a 32 bit size_t
+	const uint64_t expectedSize = sizeof(SceneFileHeader) + static_cast<uint64_t>(pHeader->m_numOfMaterials) * sizeof(SceneFileMaterial) +
+		static_cast<uint64_t>(pHeader->m_numOfSpheres) * sizeof(SceneFileSphere);
+	if (static_cast<uint64_t>(file.GetSize()) < expectedSize)
+	{
+		std::cout << fileName << " is truncated" << std::endl;
+		return false;
+	}
+
+	const SceneFileMaterial* pMaterials = reinterpret_cast<const SceneFileMaterial*>(pData + sizeof(SceneFileHeader));
+	const SceneFileSphere* pSpheres = reinterpret_cast<const SceneFileSphere*>(pMaterials + pHeader->m_numOfMaterials);
+
+	// The same checks as the text loader
+	if (!AreSceneFloatsFinite(pHeader->m_camera, 12))
+	{
+		std::cout << fileName << ": invalid camera" << std::endl;
+		return false;
+	}
+
+	int numOfMaterialsOfType[3] = {};
+	for (uint32_t i = 0; i < pHeader->m_numOfMaterials; i++)
+	{
+		if (pMaterials[i].m_type > enEmmisive || !AreSceneFloatsFinite(pMaterials[i].m_colour, 3) || !AreSceneFloatsFinite(&pMaterials[i].m_parameter, 1))
+		{
+			std::cout << fileName << ": invalid material " << i << std::endl;
+			return false;
+		}
+		numOfMaterialsOfType[pMaterials[i].m_type]++;
+	}
+	int numOfLightSpheres = 0;
+	for (uint32_t i = 0; i < pHeader->m_numOfSpheres; i++)
+	{
+		const SceneFileSphere& sphere = pSpheres[i];
+		if (sphere.m_materialIndex >= pHeader->m_numOfMaterials || !AreSceneFloatsFinite(sphere.m_center, 3) || !IsValidSceneRadius(sphere.m_radius) ||
+			(sphere.m_isLight && (!IsValidSceneRadius(sphere.m_lightRadius) || !AreSceneFloatsFinite(&sphere.m_lightIntensity, 1) || !IsValidSceneLightIntensity(sphere.m_lightIntensity))))
+		{
+			std::cout << fileName << ": invalid sphere " << i << std::endl;
+			return false;
+		}
+		numOfLightSpheres += sphere.m_isLight ? 1 : 0;
+	}
+
+	rScene.Clear();
+	rScene.Reserve(pHeader->m_numOfSpheres - numOfLightSpheres, numOfLightSpheres, numOfMaterialsOfType[enLambertianDiffuse], numOfMaterialsOfType[enMetal], numOfMaterialsOfType[enEmmisive]);
+
+	const float* pCamera = pHeader->m_camera;
+	rScene.m_camera.m_lookFrom = Vec3f(pCamera[0], pCamera[1], pCamera[2]);
+	rScene.m_camera.m_lookAt = Vec3f(pCamera[3], pCamera[4], pCamera[5]);
+	rScene.m_camera.m_up = Vec3f(pCamera[6], pCamera[7], pCamera[8]);
+	rScene.m_camera.m_verticalFov = pCamera[9];
+	rScene.m_camera.m_aperture = pCamera[10];
+	rScene.m_camera.m_focusDistance = pCamera[11];
+
+	for (uint32_t i = 0; i < pHeader->m_numOfMaterials; i++)
+	{
+		const SceneFileMaterial& material = pMaterials[i];
+		const Vec3f colour(material.m_colour[0], material.m_colour[1], material.m_colour[2]);
+		switch (material.m_type)
+		{
+		case enLambertianDiffuse:
+			rScene.AddLambertianDiffuse(colour);
+			break;
+		case enMetal:
+			rScene.AddMetal(colour, material.m_parameter);
+			break;
+		case enEmmisive:
+			rScene.AddEmmisive(colour, material.m_parameter);
+			break;
+		}
+	}
+
+	for (uint32_t i = 0; i < pHeader->m_numOfSpheres; i++)
+	{
+		const SceneFileSphere& sphere = pSpheres[i];
+		const Vec3f center(sphere.m_center[0], sphere.m_center[1], sphere.m_center[2]);
+		if (sphere.m_isLight)
+		{
+			rScene.AddLightSphere(center, sphere.m_radius, sphere.m_lightRadius, sphere.m_lightIntensity, sphere.m_materialIndex);
+		}
+		else
+		{
+			rScene.AddSphere(center, sphere.m_radius, sphere.m_materialIndex);
+		}
+	}
+
+	return true;
+}
+
+static bool LoadScene(const char* fileName, Scene& rScene)
+{
+	return IsSceneFileBinary(fileName) ? LoadSceneBinary(fileName, rScene) : LoadSceneText(fileName, rScene);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void GetSceneFileMaterial(const Material& material, SceneFileMaterial& rMaterial)
+{
+	rMaterial.m_type = material.m_materialType;
+	rMaterial.m_colour[0] = material.m_diffuseColour.r;
+	rMaterial.m_colour[1] = material.m_diffuseColour.g;
+	rMaterial.m_colour[2] = material.m_diffuseColour.b;
+	rMaterial.m_parameter = 0.0f;
+	if (material.m_materialType == enMetal)
+	{
+		rMaterial.m_parameter = material.m_fuzzyness;
+	}
+	else if (material.m_materialType == enEmmisive)
+	{
+		rMaterial.m_parameter = material.m_exposure;
+	}
+}
+
+static void GetSceneFileSphere(HitObject* pHitObject, const std::unordered_set<HitObject*>& lightObjects, SceneFileSphere& rSphere)
+{
+	Sphere* pSphere = static_cast<Sphere*>(pHitObject);
+	rSphere.m_center[0] = pSphere->m_position.x;
+	rSphere.m_center[1] = pSphere->m_position.y;
+	rSphere.m_center[2] = pSphere->m_position.z;
+	rSphere.m_radius = pSphere->m_radius;
+	rSphere.m_materialIndex = pSphere->m_materialIndex;
+	rSphere.m_isLight = lightObjects.count(pHitObject) > 0 ? 1 : 0;
+	rSphere.m_lightRadius = rSphere.m_isLight ? static_cast<LightSphere*>(pSphere)->m_lightRadius : 0.0f;
+	rSphere.m_lightIntensity = rSphere.m_isLight ? static_cast<LightSphere*>(pSphere)->m_lightIntensity : 0.0f;
+}
+
+static bool SaveScene(const char* fileName, Scene& rScene)
+{
+	const std::unordered_set<HitObject*> lightObjects(rScene.m_lightObjects.begin(), rScene.m_lightObjects.end());
+
+	const CameraSettings& camera = rScene.m_camera;
+	const float cameraValues[12] = { camera.m_lookFrom.x, camera.m_lookFrom.y, camera.m_lookFrom.z, camera.m_lookAt.x, camera.m_lookAt.y, camera.m_lookAt.z,
+		camera.m_up.x, camera.m_up.y, camera.m_up.z, camera.m_verticalFov, camera.m_aperture, camera.m_focusDistance };
+
+	FILE* pFile = fopen(fileName, "wb");
+	if (pFile == nullptr)
+	{
+		std::cout << "Failed to open " << fileName << " for writing" << std::endl;
+		return false;
+	}
+
+	bool isWritten = true;
+	if (IsSceneFileBinary(fileName))
+	{
+		SceneFileHeader header;
+		memcpy(header.m_magic, g_sceneFileMagic, 4);
+		header.m_version = g_sceneFileVersion;
+		header.m_numOfMaterials = static_cast<uint32_t>(rScene.m_materials.size());
+		header.m_numOfSpheres = static_cast<uint32_t>(rScene.m_hitObjects.size());
+		memcpy(header.m_camera, cameraValues, sizeof(cameraValues));
+
+		std::vector<SceneFileMaterial> materials(rScene.m_materials.size());
+		for (size_t i = 0; i < materials.size(); i++)
+		{
+			GetSceneFileMaterial(rScene.m_materials[i], materials[i]);
+		}
+
+		std::vector<SceneFileSphere> spheres(rScene.m_hitObjects.size());
+		for (size_t i = 0; i < spheres.size(); i++)
+		{
+			GetSceneFileSphere(rScene.m_hitObjects[i], lightObjects, spheres[i]);
+		}
+
+		isWritten = fwrite(&header, sizeof(header), 1, pFile) == 1;
+		isWritten = isWritten && (materials.empty() || fwrite(materials.data(), sizeof(SceneFileMaterial), materials.size(), pFile) == materials.size());
+		isWritten = isWritten && (spheres.empty() || fwrite(spheres.data(), sizeof(SceneFileSphere), spheres.size(), pFile) == spheres.size());
+	}
+	else
+	{
+		fprintf(pFile, "camera");
+		for (float value : cameraValues)
+		{
+			fprintf(pFile, " %.9g", value);
+		}
+		fprintf(pFile, "\n");
+
+		const char* materialKeywords[] = { "lambertian", "metal", "emmisive" };
+		for (const Material& sceneMaterial : rScene.m_materials)
+		{
+			SceneFileMaterial material;
+			GetSceneFileMaterial(sceneMaterial, material);
+			fprintf(pFile, "%s %.9g %.9g %.9g", materialKeywords[material.m_type], material.m_colour[0], material.m_colour[1], material.m_colour[2]);
+			if (material.m_type != enLambertianDiffuse)
+			{
+				fprintf(pFile, " %.9g", material.m_parameter);
+			}
+			fprintf(pFile, "\n");
+		}
+
+		for (HitObject* pHitObject : rScene.m_hitObjects)
+		{
+			SceneFileSphere sphere;
+			GetSceneFileSphere(pHitObject, lightObjects, sphere);
+			if (sphere.m_isLight)
+			{
+				fprintf(pFile, "light %.9g %.9g %.9g %.9g %.9g %.9g %u\n", sphere.m_center[0], sphere.m_center[1], sphere.m_center[2], sphere.m_radius, sphere.m_lightRadius, sphere.m_lightIntensity, sphere.m_materialIndex);
+			}
+			else
+			{
+				fprintf(pFile, "sphere %.9g %.9g %.9g %.9g %u\n", sphere.m_center[0], sphere.m_center[1], sphere.m_center[2], sphere.m_radius, sphere.m_materialIndex);
+			}
+		}
+		isWritten = ferror(pFile) == 0;
+	}
+
+	fclose(pFile);
+	return isWritten;
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <math.h>
+#include <vector>
+
+#include "Random.h"
+#include "Scene.h"
+
+// Uniform hash grid of spheres, used to check a new sphere against its neighbours only rather than every sphere.
+// The cell size is the diameter of the largest sphere stored in the grid, so only the 27 cells around a new
+// sphere can hold spheres that touch it. Spheres bigger than that are kept in a short list checked one by one.
+class SpawnGrid
+{
+public:
+	SpawnGrid(float maxRadius, int expectedNumOfSpheres)
+		:m_maxRadius(maxRadius)
+		,m_cellSize(maxRadius * 2.0f)
+	{
+		int tableSize = 1;
+		while (tableSize < expectedNumOfSpheres * 2)
+		{
+			tableSize *= 2;
+		}
+		m_cellHeads.assign(tableSize, -1);
+		m_next.reserve(expectedNumOfSpheres);
+		m_centers.reserve(expectedNumOfSpheres);
+		m_radii.reserve(expectedNumOfSpheres);
+	}
+
+	void Add(const Vec3f& center, float radius)
+	{
+		if (radius > m_maxRadius)
+		{
+			m_largeCenters.push_back(center);
+			m_largeRadii.push_back(radius);
+			return;
+		}
+
+		const int sphereIndex = static_cast<int>(m_centers.size());
+		const int bucket = GetBucket(GetCell(center.x), GetCell(center.y), GetCell(center.z));
+		m_centers.push_back(center);
+		m_radii.push_back(radius);
+		m_next.push_back(m_cellHeads[bucket]);
+		m_cellHeads[bucket] = sphereIndex;
+	}
+
+	// Same rule as the old linear CanSpawnSphere: spheres must not touch
+	bool CanSpawn(const Vec3f& center, float radius)
+	{
+		for (size_t i = 0; i < m_largeCenters.size(); i++)
+		{
+			if (IsTouching(center, radius, m_largeCenters[i], m_largeRadii[i]))
+			{
+				return false;
+			}
+		}
+
+		const int cellX = GetCell(center.x);
+		const int cellY = GetCell(center.y);
+		const int cellZ = GetCell(center.z);
+		for (int z = cellZ - 1; z <= cellZ + 1; z++)
+		{
+			for (int y = cellY - 1; y <= cellY + 1; y++)
+			{
+				for (int x = cellX - 1; x <= cellX + 1; x++)
+				{
+					// Different cells can share a bucket, which only costs a few extra checks
+					for (int i = m_cellHeads[GetBucket(x, y, z)]; i != -1; i = m_next[i])
+					{
+						if (IsTouching(center, radius, m_centers[i], m_radii[i]))
+						{
+							return false;
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	static bool IsTouching(const Vec3f& centerA, float radiusA, const Vec3f& centerB, float radiusB)
+	{
+		const float dx = centerA.x - centerB.x;
+		const float dy = centerA.y - centerB.y;
+		const float dz = centerA.z - centerB.z;
+		const float minDistance = radiusA + radiusB;
+		return dx * dx + dy * dy + dz * dz <= minDistance * minDistance;
+	}
+
+	int GetCell(float position) const
+	{
+		return static_cast<int>(floorf(position / m_cellSize));
+	}
+
+	int GetBucket(int x, int y, int z) const
+	{
+		const unsigned int hash = (static_cast<unsigned int>(x) * 73856093u) ^ (static_cast<unsigned int>(y) * 19349663u) ^ (static_cast<unsigned int>(z) * 83492791u);
+		return static_cast<int>(hash & (m_cellHeads.size() - 1));
+	}
+
+	float m_maxRadius;
+	float m_cellSize;
+	std::vector<int> m_cellHeads;	// First sphere of each bucket
+	std::vector<int> m_next;		// Next sphere in the same bucket
+	std::vector<Vec3f> m_centers;
+	std::vector<float> m_radii;
+	std::vector<Vec3f> m_largeCenters;
+	std::vector<float> m_largeRadii;
+};
+
+struct SphereFieldSettings
+{
+	SphereFieldSettings()
+		:m_numOfSpheres(100)
+		,m_density(0.27f)
+		,m_center(0.0f, 0.0f, 0.0f)
+		,m_minRadius(0.2f)
+		,m_maxRadius(0.4f)
+		,m_metalChance(0.25f)
+		,m_maxAttemptsPerSphere(1000)
+		,m_seed(0)
+	{
+	}
+
+	int m_numOfSpheres;
+	float m_density;			// Spheres per square unit of ground, which sets the size of the field
+	Vec3f m_center;				// Center of the square field on the ground
+	float m_minRadius;
+	float m_maxRadius;
+	float m_metalChance;		// The rest are lambertian diffuse
+	int m_maxAttemptsPerSphere;	// Gives up on a sphere that can't find a free spot, so very dense fields still finish
+	uint64_t m_seed;
+};
+
+// The generators add nothing for settings that can't make a field, written so NaNs fail too
+static bool IsValidSphereFieldSettings(const SphereFieldSettings& settings)
+{
+	return settings.m_numOfSpheres >= 0 && settings.m_density > 0.0f && settings.m_minRadius > 0.0f && settings.m_maxRadius >= settings.m_minRadius;
+}
+
+// Number of scene entries GenerateSphereField can add, for Scene::Reserve
+static void GetSphereFieldReserveCounts(const SphereFieldSettings& settings, int& rNumOfSpheres, int& rNumOfLambertianDiffuses, int& rNumOfMetals)
+{
+	if (!IsValidSphereFieldSettings(settings))
+	{
+		rNumOfSpheres = 0;
+		rNumOfLambertianDiffuses = 0;
+		rNumOfMetals = 0;
+		return;
+	}
+
+	rNumOfSpheres = settings.m_numOfSpheres;
+	rNumOfLambertianDiffuses = settings.m_numOfSpheres;
+	rNumOfMetals = settings.m_numOfSpheres;
+}
+
+// Scatters randomly sized diffuse and metal spheres resting on the ground (y = 0) without letting them touch each
+// other or any sphere already in the scene. Returns the number of spheres placed.
+static int GenerateSphereField(Scene& rScene, const SphereFieldSettings& settings)
+{
+	if (!IsValidSphereFieldSettings(settings))
+	{
+		return 0;
+	}
+
+	const float fieldSize = sqrtf(settings.m_numOfSpheres / settings.m_density);
+	Random random(settings.m_seed);
+
+	SpawnGrid spawnGrid(settings.m_maxRadius, static_cast<int>(rScene.m_hitObjects.size()) + settings.m_numOfSpheres);
+	for (HitObject* pHitObject : rScene.m_hitObjects)
+	{
+		spawnGrid.Add(pHitObject->m_position, static_cast<Sphere*>(pHitObject)->m_radius);
+	}
+
+	int numOfSpheresPlaced = 0;
+	for (int i = 0; i < settings.m_numOfSpheres; i++)
+	{
+		for (int attempt = 0; attempt < settings.m_maxAttemptsPerSphere; attempt++)
+		{
+			float radius = settings.m_minRadius + random.NextFloat() * (settings.m_maxRadius - settings.m_minRadius);
+			Vec3f center(settings.m_center.x + (random.NextFloat() - 0.5f) * fieldSize, radius, settings.m_center.z + (random.NextFloat() - 0.5f) * fieldSize);
+			if (!spawnGrid.CanSpawn(center, radius))
+			{
+				continue;
+			}
+
+			spawnGrid.Add(center, radius);
+			numOfSpheresPlaced++;
+
+			if (random.NextFloat() >= settings.m_metalChance)
+			{
+				Vec3f colour;
+				while (colour.magnitude() < 0.1f) // Make sure the random colour isn't too dark
+				{
+					colour = Vec3f(random.NextFloat() * random.NextFloat(), random.NextFloat() * random.NextFloat(), random.NextFloat() * random.NextFloat());
+				}
+				rScene.AddSphere(center, radius, rScene.AddLambertianDiffuse(colour));
+			}
+			else
+			{
+				rScene.AddSphere(center, radius, rScene.AddMetal(Vec3f(0.5f * (1.0f + random.NextFloat()), 0.5f * (1.0f + random.NextFloat()), 0.5f * (1.0f + random.NextFloat())), 0.5f * random.NextFloat()));
+			}
+			break;
+		}
+	}
+
+	return numOfSpheresPlaced;
+}
+
+// Scatters small lights resting on the ground over the same square as GenerateSphereField, without letting them touch
+// any sphere already in the scene. Call it before GenerateSphereField so the field keeps clear of the lights.
+// Needs room for numOfLights light spheres and emmisive materials. Returns the number of lights placed.
+static int GenerateLightField(Scene& rScene, const SphereFieldSettings& settings, int numOfLights)
+{
+	if (!IsValidSphereFieldSettings(settings))
+	{
+		return 0;
+	}
+
+	const float fieldSize = sqrtf(settings.m_numOfSpheres / settings.m_density);
+	const float radius = 0.2f;
+	Random random(HashSeed(settings.m_seed, 1));
+
+	int numOfLightsPlaced = 0;
+	for (int i = 0; i < numOfLights; i++)
+	{
+		for (int attempt = 0; attempt < settings.m_maxAttemptsPerSphere; attempt++)
+		{
+			Vec3f center(settings.m_center.x + (random.NextFloat() - 0.5f) * fieldSize, radius, settings.m_center.z + (random.NextFloat() - 0.5f) * fieldSize);
+
+			// Only a handful of spheres exist yet, so checking them all is fine
+			bool isTouching = false;
+			for (HitObject* pHitObject : rScene.m_hitObjects)
+			{
+				const Vec3f offset = center - pHitObject->m_position;
+				const float minDistance = radius + static_cast<Sphere*>(pHitObject)->m_radius;
+				if (offset.x * offset.x + offset.y * offset.y + offset.z * offset.z <= minDistance * minDistance)
+				{
+					isTouching = true;
+					break;
+				}
+			}
+			if (isTouching)
+			{
+				continue;
+			}
+
+			Vec3f colour(0.5f + 0.5f * random.NextFloat(), 0.5f + 0.5f * random.NextFloat(), 0.5f + 0.5f * random.NextFloat());
+			rScene.AddLightSphere(center, radius, 4.0f, 0.5f, rScene.AddEmmisive(colour, 2.0f));
+			numOfLightsPlaced++;
+			break;
+		}
+	}
+
+	return numOfLightsPlaced;
+}
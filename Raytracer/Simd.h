@@ -0,0 +1,48 @@
+#pragma once
+
+// Runtime instruction set detection. SIMD_TARGET_AVX2 lets a single function use AVX2 without building the whole
+// program for it, callers have to check GetSupportedSimdLevel first.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+enum SimdLevel
+{
+	enScalar,
+	enSSE,
+	enAVX2
+};
+
+// Best instruction set the CPU and OS support
+static SimdLevel GetSupportedSimdLevel()
+{
+#if defined(SIMD_X86)
+#if defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 0);
+	const int maxLeaf = cpuInfo[0];
+	__cpuid(cpuInfo, 1);
+	const bool hasOSXSave = (cpuInfo[2] & (1 << 27)) != 0;
+	const bool hasAVX = (cpuInfo[2] & (1 << 28)) != 0;
+	bool hasAVX2 = false;
+	if (maxLeaf >= 7 && hasOSXSave && hasAVX && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(cpuInfo, 7, 0);
+		hasAVX2 = (cpuInfo[1] & (1 << 5)) != 0;
+	}
+	return hasAVX2 ? enAVX2 : enSSE;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? enAVX2 : enSSE;
+#endif
+#else
+	return enScalar;
+#endif
+}
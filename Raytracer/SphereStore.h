@@ -0,0 +1,352 @@
+#pragma once
+
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "HitObjects.h"
+#include "Simd.h"
+
+// Structure of arrays copy of the spheres, laid out so SIMD kernels can test one ray against several spheres at once
+class SphereStore
+{
+public:
+	SphereStore()
+		:m_simdLevel(GetSupportedSimdLevel())
+	{
+	}
+
+	void Build(const std::vector<HitObject*>& hitObjects)
+	{
+		const size_t count = hitObjects.size();
+		// Padding so an 8 wide load starting at the last sphere stays inside the arrays
+		const size_t paddedCount = count + 8;
+		m_centerX.assign(paddedCount, 0.0f);
+		m_centerY.assign(paddedCount, 0.0f);
+		m_centerZ.assign(paddedCount, 0.0f);
+		m_radiusSquared.assign(paddedCount, 0.0f);
+		m_objectIds.assign(paddedCount, -1);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			Sphere* pSphere = static_cast<Sphere*>(hitObjects[i]);
+			m_centerX[i] = pSphere->m_position.x;
+			m_centerY[i] = pSphere->m_position.y;
+			m_centerZ[i] = pSphere->m_position.z;
+			m_radiusSquared[i] = pSphere->m_radius * pSphere->m_radius;
+			m_objectIds[i] = static_cast<int>(i);
+		}
+	}
+
+	void SetSimdLevel(SimdLevel simdLevel)
+	{
+		m_simdLevel = std::min(simdLevel, GetSupportedSimdLevel());
+	}
+
+	SimdLevel GetSimdLevel() const
+	{
+		return m_simdLevel;
+	}
+
+	// Tests the ray against spheres [first, first + count). When one is hit closer than rMaxHitDistance, that distance
+	// and the sphere's object id are written out.
+	bool HasHit(int first, int count, const Vec3f& origin, const Vec3f& direction, float minHitDistance, float& rMaxHitDistance, int& rObjectId) const
+	{
+		switch (m_simdLevel)
+		{
+#if defined(SIMD_X86)
+		case enAVX2:
+			return HasHitAVX2(first, count, origin, direction, minHitDistance, rMaxHitDistance, rObjectId);
+		case enSSE:
+			return HasHitSSE(first, count, origin, direction, minHitDistance, rMaxHitDistance, rObjectId);
+#endif
+		default:
+			return HasHitScalar(first, count, origin, direction, minHitDistance, rMaxHitDistance, rObjectId);
+		}
+	}
+
+	// True as soon as any of spheres [first, first + count) is hit between the two distances
+	bool IsOccluded(int first, int count, const Vec3f& origin, const Vec3f& direction, float minHitDistance, float maxHitDistance) const
+	{
+		switch (m_simdLevel)
+		{
+#if defined(SIMD_X86)
+		case enAVX2:
+			return IsOccludedAVX2(first, count, origin, direction, minHitDistance, maxHitDistance);
+		case enSSE:
+			return IsOccludedSSE(first, count, origin, direction, minHitDistance, maxHitDistance);
+#endif
+		default:
+			return IsOccludedScalar(first, count, origin, direction, minHitDistance, maxHitDistance);
+		}
+	}
+
+private:
+	bool HasHitScalar(int first, int count, const Vec3f& origin, const Vec3f& direction, float minHitDistance, float& rMaxHitDistance, int& rObjectId) const
+	{
+		bool hasHit = false;
+		const float a = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+		for (int i = first; i < first + count; i++)
+		{
+			const float ocX = origin.x - m_centerX[i];
+			const float ocY = origin.y - m_centerY[i];
+			const float ocZ = origin.z - m_centerZ[i];
+			const float b = ocX * direction.x + ocY * direction.y + ocZ * direction.z;
+			const float c = ocX * ocX + ocY * ocY + ocZ * ocZ - m_radiusSquared[i];
+			const float discriminant = b * b - a * c;
+			if (discriminant > 0.0f)
+			{
+				const float root = sqrtf(discriminant);
+				float t = (-b - root) / a;
+				if (!(t < rMaxHitDistance && t > minHitDistance))
+				{
+					t = (-b + root) / a;
+				}
+				if (t < rMaxHitDistance && t > minHitDistance)
+				{
+					rMaxHitDistance = t;
+					rObjectId = m_objectIds[i];
+					hasHit = true;
+				}
+			}
+		}
+		return hasHit;
+	}
+
+	bool IsOccludedScalar(int first, int count, const Vec3f& origin, const Vec3f& direction, float minHitDistance, float maxHitDistance) const
+	{
+		const float a = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+		for (int i = first; i < first + count; i++)
+		{
+			const float ocX = origin.x - m_centerX[i];
+			const float ocY = origin.y - m_centerY[i];
+			const float ocZ = origin.z - m_centerZ[i];
+			const float b = ocX * direction.x + ocY * direction.y + ocZ * direction.z;
+			const float c = ocX * ocX + ocY * ocY + ocZ * ocZ - m_radiusSquared[i];
+			const float discriminant = b * b - a * c;
+			if (discriminant > 0.0f)
+			{
+				const float root = sqrtf(discriminant);
+				const float nearT = (-b - root) / a;
+				const float farT = (-b + root) / a;
+				if ((nearT < maxHitDistance && nearT > minHitDistance) || (farT < maxHitDistance && farT > minHitDistance))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+#if defined(SIMD_X86)
+	bool HasHitSSE(int first, int count, const Vec3f& origin, const Vec3f& direction, float minHitDistance, float& rMaxHitDistance, int& rObjectId) const
+	{
+		const __m128 originX = _mm_set1_ps(origin.x);
+		const __m128 originY = _mm_set1_ps(origin.y);
+		const __m128 originZ = _mm_set1_ps(origin.z);
+		const __m128 directionX = _mm_set1_ps(direction.x);
+		const __m128 directionY = _mm_set1_ps(direction.y);
+		const __m128 directionZ = _mm_set1_ps(direction.z);
+		const __m128 a = _mm_set1_ps(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		const __m128 invA = _mm_div_ps(_mm_set1_ps(1.0f), a);
+		const __m128 minT = _mm_set1_ps(minHitDistance);
+		const __m128 laneIndex = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+		bool hasHit = false;
+		for (int i = first; i < first + count; i += 4)
+		{
+			const __m128 maxT = _mm_set1_ps(rMaxHitDistance);
+			const __m128 ocX = _mm_sub_ps(originX, _mm_loadu_ps(&m_centerX[i]));
+			const __m128 ocY = _mm_sub_ps(originY, _mm_loadu_ps(&m_centerY[i]));
+			const __m128 ocZ = _mm_sub_ps(originZ, _mm_loadu_ps(&m_centerZ[i]));
+			const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, directionX), _mm_mul_ps(ocY, directionY)), _mm_mul_ps(ocZ, directionZ));
+			const __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ)), _mm_loadu_ps(&m_radiusSquared[i]));
+			const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+
+			const __m128 inRange = _mm_cmplt_ps(laneIndex, _mm_set1_ps(static_cast<float>(first + count - i)));
+			const __m128 hitMask = _mm_and_ps(_mm_cmpgt_ps(discriminant, _mm_setzero_ps()), inRange);
+			if (_mm_movemask_ps(hitMask) == 0)
+			{
+				continue;
+			}
+
+			const __m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, _mm_setzero_ps()));
+			const __m128 nearT = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), b), root), invA);
+			const __m128 farT = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), b), root), invA);
+			const __m128 nearValid = _mm_and_ps(_mm_cmpgt_ps(nearT, minT), _mm_cmplt_ps(nearT, maxT));
+			const __m128 farValid = _mm_and_ps(_mm_cmpgt_ps(farT, minT), _mm_cmplt_ps(farT, maxT));
+			const __m128 t = _mm_or_ps(_mm_and_ps(nearValid, nearT), _mm_andnot_ps(nearValid, farT));
+			const int validMask = _mm_movemask_ps(_mm_and_ps(hitMask, _mm_or_ps(nearValid, farValid)));
+			if (validMask == 0)
+			{
+				continue;
+			}
+
+			alignas(16) float distances[4];
+			_mm_store_ps(distances, t);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				if ((validMask & (1 << lane)) && distances[lane] < rMaxHitDistance)
+				{
+					rMaxHitDistance = distances[lane];
+					rObjectId = m_objectIds[i + lane];
+					hasHit = true;
+				}
+			}
+		}
+		return hasHit;
+	}
+
+	bool IsOccludedSSE(int first, int count, const Vec3f& origin, const Vec3f& direction, float minHitDistance, float maxHitDistance) const
+	{
+		const __m128 originX = _mm_set1_ps(origin.x);
+		const __m128 originY = _mm_set1_ps(origin.y);
+		const __m128 originZ = _mm_set1_ps(origin.z);
+		const __m128 directionX = _mm_set1_ps(direction.x);
+		const __m128 directionY = _mm_set1_ps(direction.y);
+		const __m128 directionZ = _mm_set1_ps(direction.z);
+		const __m128 a = _mm_set1_ps(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		const __m128 invA = _mm_div_ps(_mm_set1_ps(1.0f), a);
+		const __m128 minT = _mm_set1_ps(minHitDistance);
+		const __m128 maxT = _mm_set1_ps(maxHitDistance);
+		const __m128 laneIndex = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+		for (int i = first; i < first + count; i += 4)
+		{
+			const __m128 ocX = _mm_sub_ps(originX, _mm_loadu_ps(&m_centerX[i]));
+			const __m128 ocY = _mm_sub_ps(originY, _mm_loadu_ps(&m_centerY[i]));
+			const __m128 ocZ = _mm_sub_ps(originZ, _mm_loadu_ps(&m_centerZ[i]));
+			const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, directionX), _mm_mul_ps(ocY, directionY)), _mm_mul_ps(ocZ, directionZ));
+			const __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ)), _mm_loadu_ps(&m_radiusSquared[i]));
+			const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+
+			const __m128 inRange = _mm_cmplt_ps(laneIndex, _mm_set1_ps(static_cast<float>(first + count - i)));
+			const __m128 hitMask = _mm_and_ps(_mm_cmpgt_ps(discriminant, _mm_setzero_ps()), inRange);
+			if (_mm_movemask_ps(hitMask) == 0)
+			{
+				continue;
+			}
+
+			const __m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, _mm_setzero_ps()));
+			const __m128 nearT = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), b), root), invA);
+			const __m128 farT = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), b), root), invA);
+			const __m128 nearValid = _mm_and_ps(_mm_cmpgt_ps(nearT, minT), _mm_cmplt_ps(nearT, maxT));
+			const __m128 farValid = _mm_and_ps(_mm_cmpgt_ps(farT, minT), _mm_cmplt_ps(farT, maxT));
+			if (_mm_movemask_ps(_mm_and_ps(hitMask, _mm_or_ps(nearValid, farValid))) != 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	SIMD_TARGET_AVX2 bool IsOccludedAVX2(int first, int count, const Vec3f& origin, const Vec3f& direction, float minHitDistance, float maxHitDistance) const
+	{
+		const __m256 originX = _mm256_set1_ps(origin.x);
+		const __m256 originY = _mm256_set1_ps(origin.y);
+		const __m256 originZ = _mm256_set1_ps(origin.z);
+		const __m256 directionX = _mm256_set1_ps(direction.x);
+		const __m256 directionY = _mm256_set1_ps(direction.y);
+		const __m256 directionZ = _mm256_set1_ps(direction.z);
+		const __m256 a = _mm256_set1_ps(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		const __m256 invA = _mm256_div_ps(_mm256_set1_ps(1.0f), a);
+		const __m256 minT = _mm256_set1_ps(minHitDistance);
+		const __m256 maxT = _mm256_set1_ps(maxHitDistance);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 laneIndex = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+		for (int i = first; i < first + count; i += 8)
+		{
+			const __m256 ocX = _mm256_sub_ps(originX, _mm256_loadu_ps(&m_centerX[i]));
+			const __m256 ocY = _mm256_sub_ps(originY, _mm256_loadu_ps(&m_centerY[i]));
+			const __m256 ocZ = _mm256_sub_ps(originZ, _mm256_loadu_ps(&m_centerZ[i]));
+			const __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, directionX), _mm256_mul_ps(ocY, directionY)), _mm256_mul_ps(ocZ, directionZ));
+			const __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, ocX), _mm256_mul_ps(ocY, ocY)), _mm256_mul_ps(ocZ, ocZ)), _mm256_loadu_ps(&m_radiusSquared[i]));
+			const __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+
+			const __m256 inRange = _mm256_cmp_ps(laneIndex, _mm256_set1_ps(static_cast<float>(first + count - i)), _CMP_LT_OQ);
+			const __m256 hitMask = _mm256_and_ps(_mm256_cmp_ps(discriminant, zero, _CMP_GT_OQ), inRange);
+			if (_mm256_movemask_ps(hitMask) == 0)
+			{
+				continue;
+			}
+
+			const __m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+			const __m256 nearT = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(zero, b), root), invA);
+			const __m256 farT = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(zero, b), root), invA);
+			const __m256 nearValid = _mm256_and_ps(_mm256_cmp_ps(nearT, minT, _CMP_GT_OQ), _mm256_cmp_ps(nearT, maxT, _CMP_LT_OQ));
+			const __m256 farValid = _mm256_and_ps(_mm256_cmp_ps(farT, minT, _CMP_GT_OQ), _mm256_cmp_ps(farT, maxT, _CMP_LT_OQ));
+			if (_mm256_movemask_ps(_mm256_and_ps(hitMask, _mm256_or_ps(nearValid, farValid))) != 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	SIMD_TARGET_AVX2 bool HasHitAVX2(int first, int count, const Vec3f& origin, const Vec3f& direction, float minHitDistance, float& rMaxHitDistance, int& rObjectId) const
+	{
+		const __m256 originX = _mm256_set1_ps(origin.x);
+		const __m256 originY = _mm256_set1_ps(origin.y);
+		const __m256 originZ = _mm256_set1_ps(origin.z);
+		const __m256 directionX = _mm256_set1_ps(direction.x);
+		const __m256 directionY = _mm256_set1_ps(direction.y);
+		const __m256 directionZ = _mm256_set1_ps(direction.z);
+		const __m256 a = _mm256_set1_ps(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		const __m256 invA = _mm256_div_ps(_mm256_set1_ps(1.0f), a);
+		const __m256 minT = _mm256_set1_ps(minHitDistance);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 laneIndex = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+		bool hasHit = false;
+		for (int i = first; i < first + count; i += 8)
+		{
+			const __m256 maxT = _mm256_set1_ps(rMaxHitDistance);
+			const __m256 ocX = _mm256_sub_ps(originX, _mm256_loadu_ps(&m_centerX[i]));
+			const __m256 ocY = _mm256_sub_ps(originY, _mm256_loadu_ps(&m_centerY[i]));
+			const __m256 ocZ = _mm256_sub_ps(originZ, _mm256_loadu_ps(&m_centerZ[i]));
+			const __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, directionX), _mm256_mul_ps(ocY, directionY)), _mm256_mul_ps(ocZ, directionZ));
+			const __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, ocX), _mm256_mul_ps(ocY, ocY)), _mm256_mul_ps(ocZ, ocZ)), _mm256_loadu_ps(&m_radiusSquared[i]));
+			const __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+
+			const __m256 inRange = _mm256_cmp_ps(laneIndex, _mm256_set1_ps(static_cast<float>(first + count - i)), _CMP_LT_OQ);
+			const __m256 hitMask = _mm256_and_ps(_mm256_cmp_ps(discriminant, zero, _CMP_GT_OQ), inRange);
+			if (_mm256_movemask_ps(hitMask) == 0)
+			{
+				continue;
+			}
+
+			const __m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+			const __m256 nearT = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(zero, b), root), invA);
+			const __m256 farT = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(zero, b), root), invA);
+			const __m256 nearValid = _mm256_and_ps(_mm256_cmp_ps(nearT, minT, _CMP_GT_OQ), _mm256_cmp_ps(nearT, maxT, _CMP_LT_OQ));
+			const __m256 farValid = _mm256_and_ps(_mm256_cmp_ps(farT, minT, _CMP_GT_OQ), _mm256_cmp_ps(farT, maxT, _CMP_LT_OQ));
+			const __m256 t = _mm256_blendv_ps(farT, nearT, nearValid);
+			const int validMask = _mm256_movemask_ps(_mm256_and_ps(hitMask, _mm256_or_ps(nearValid, farValid)));
+			if (validMask == 0)
+			{
+				continue;
+			}
+
+			alignas(32) float distances[8];
+			_mm256_store_ps(distances, t);
+			for (int lane = 0; lane < 8; lane++)
+			{
+				if ((validMask & (1 << lane)) && distances[lane] < rMaxHitDistance)
+				{
+					rMaxHitDistance = distances[lane];
+					rObjectId = m_objectIds[i + lane];
+					hasHit = true;
+				}
+			}
+		}
+		return hasHit;
+	}
+#endif
+
+	std::vector<float, AlignedAllocator<float, 32>> m_centerX;
+	std::vector<float, AlignedAllocator<float, 32>> m_centerY;
+	std::vector<float, AlignedAllocator<float, 32>> m_centerZ;
+	std::vector<float, AlignedAllocator<float, 32>> m_radiusSquared;
+	std::vector<int, AlignedAllocator<int, 32>> m_objectIds;
+	SimdLevel m_simdLevel;
+};
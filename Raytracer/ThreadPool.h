@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define THREADPOOL_ROWS_PER_TASK 16
+
+// Fixed set of worker threads that run indexed tasks. Every worker owns a deque of tasks, taking work from
+// its front and, once it runs dry, stealing from the back of the other workers' deques.
+class ThreadPool
+{
+public:
+	// numOfThreads of 0 uses one thread per hardware thread
+	ThreadPool(int numOfThreads = 0)
+		:m_generation(0)
+		,m_isQuitting(false)
+		,m_remainingTasks(0)
+	{
+		if (numOfThreads <= 0)
+		{
+			numOfThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		}
+
+		m_queues = std::vector<WorkQueue>(numOfThreads);
+		for (int i = 0; i < numOfThreads; i++)
+		{
+			m_workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isQuitting = true;
+		}
+		m_startCondition.notify_all();
+
+		for (std::thread& rWorker : m_workers)
+		{
+			rWorker.join();
+		}
+	}
+
+	// Calls task(taskIndex, threadIndex) for every taskIndex in [0, numOfTasks) and blocks until all of them are done
+	void Run(int numOfTasks, std::function<void(int, int)> task)
+	{
+		if (numOfTasks <= 0)
+		{
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_task = task;
+		m_remainingTasks = numOfTasks;
+
+		// Hand out contiguous runs of tasks so neighbouring tiles start on the same worker
+		const int numOfThreads = GetNumOfThreads();
+		for (int i = 0; i < numOfThreads; i++)
+		{
+			std::lock_guard<std::mutex> queueLock(m_queues[i].m_mutex);
+			for (int taskIndex = (numOfTasks * i) / numOfThreads; taskIndex < (numOfTasks * (i + 1)) / numOfThreads; taskIndex++)
+			{
+				m_queues[i].m_tasks.push_back(taskIndex);
+			}
+		}
+
+		m_generation++;
+		m_startCondition.notify_all();
+		m_doneCondition.wait(lock, [this]() { return m_remainingTasks == 0; });
+	}
+
+	// Calls function(y) for every row y in [0, numOfRows), handing the rows out in blocks, and blocks until all of
+	// them are done
+	template <typename Function>
+	void ForEachRow(int numOfRows, Function function)
+	{
+		const int numOfTasks = (numOfRows + THREADPOOL_ROWS_PER_TASK - 1) / THREADPOOL_ROWS_PER_TASK;
+		Run(numOfTasks, [&](int taskIndex, int)
+		{
+			const int lastRow = std::min(numOfRows, (taskIndex + 1) * THREADPOOL_ROWS_PER_TASK);
+			for (int y = taskIndex * THREADPOOL_ROWS_PER_TASK; y < lastRow; y++)
+			{
+				function(y);
+			}
+		});
+	}
+
+	int GetNumOfThreads() const
+	{
+		return static_cast<int>(m_workers.size());
+	}
+
+private:
+	struct WorkQueue
+	{
+		std::mutex m_mutex;
+		std::deque<int> m_tasks;
+	};
+
+	bool PopTask(int threadIndex, int& rTaskIndex)
+	{
+		WorkQueue& rQueue = m_queues[threadIndex];
+		std::lock_guard<std::mutex> lock(rQueue.m_mutex);
+		if (rQueue.m_tasks.empty())
+		{
+			return false;
+		}
+		rTaskIndex = rQueue.m_tasks.front();
+		rQueue.m_tasks.pop_front();
+		return true;
+	}
+
+	bool StealTask(int threadIndex, int& rTaskIndex)
+	{
+		const int numOfThreads = GetNumOfThreads();
+		for (int i = 1; i < numOfThreads; i++)
+		{
+			WorkQueue& rVictim = m_queues[(threadIndex + i) % numOfThreads];
+			std::lock_guard<std::mutex> lock(rVictim.m_mutex);
+			if (!rVictim.m_tasks.empty())
+			{
+				rTaskIndex = rVictim.m_tasks.back();
+				rVictim.m_tasks.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WorkerLoop(int threadIndex)
+	{
+		unsigned int seenGeneration = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_startCondition.wait(lock, [&]() { return m_isQuitting || m_generation != seenGeneration; });
+				if (m_isQuitting)
+				{
+					return;
+				}
+				seenGeneration = m_generation;
+			}
+
+			int taskIndex = 0;
+			while (PopTask(threadIndex, taskIndex) || StealTask(threadIndex, taskIndex))
+			{
+				m_task(taskIndex, threadIndex);
+
+				if (--m_remainingTasks == 0)
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_doneCondition.notify_all();
+				}
+			}
+		}
+	}
+
+	std::vector<std::thread> m_workers;
+	std::vector<WorkQueue> m_queues;
+	std::function<void(int, int)> m_task;
+
+	std::mutex m_mutex;
+	std::condition_variable m_startCondition;
+	std::condition_variable m_doneCondition;
+	unsigned int m_generation;
+	bool m_isQuitting;
+	std::atomic<int> m_remainingTasks;
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Framebuffer.h"
+#include "MathClass.h"
+#include "Profiler.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#define TONEMAP_SRGB_TABLE_SIZE 4096
+#define TONEMAP_DITHER_ROW_SIZE 24 // Floats in a row of the dither pattern, 8 pixels of 3 channels
+
+#if defined(SIMD_X86)
+SIMD_TARGET_AVX2 static inline __m256 SaturateAVX2(__m256 x)
+{
+	// x goes first so a NaN comes out as 0
+	return _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+}
+#endif
+
+// Tone map operators, picked with a template argument so the inner loop doesn't branch on them. Each maps an
+// exposed HDR channel value to [0, 1], either one value or 8 at a time.
+struct ACESToneMap
+{
+	static float Apply(float x)
+	{
+		return Clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), 0.0f, 1.0f);
+	}
+
+#if defined(SIMD_X86)
+	SIMD_TARGET_AVX2 static __m256 Apply(__m256 x)
+	{
+		const __m256 numerator = _mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.51f), x), _mm256_set1_ps(0.03f)));
+		const __m256 denominator = _mm256_add_ps(_mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.43f), x), _mm256_set1_ps(0.59f))), _mm256_set1_ps(0.14f));
+		return SaturateAVX2(_mm256_div_ps(numerator, denominator));
+	}
+#endif
+};
+
+struct ReinhardToneMap
+{
+	static float Apply(float x)
+	{
+		return Clamp(x / (1.0f + x), 0.0f, 1.0f);
+	}
+
+#if defined(SIMD_X86)
+	SIMD_TARGET_AVX2 static __m256 Apply(__m256 x)
+	{
+		return SaturateAVX2(_mm256_div_ps(x, _mm256_add_ps(_mm256_set1_ps(1.0f), x)));
+	}
+#endif
+};
+
+// Just the exposure, anything brighter than 1 clips
+struct ExposureToneMap
+{
+	static float Apply(float x)
+	{
+		return Clamp(x, 0.0f, 1.0f);
+	}
+
+#if defined(SIMD_X86)
+	SIMD_TARGET_AVX2 static __m256 Apply(__m256 x)
+	{
+		return SaturateAVX2(x);
+	}
+#endif
+};
+
+// Turns the HDR framebuffer into 8 bit sRGB. Rows are spread over the thread pool, and as a row of Vec3f is just
+// a run of floats and every operator works on each channel alone, the AVX2 path maps 8 floats at a time without
+// caring where one pixel ends and the next begins. An ordered dither hides the banding of the 8 bit output.
+class ToneMapper
+{
+public:
+	ToneMapper()
+		:m_exposure(1.0f)
+		,m_simdLevel(GetSupportedSimdLevel())
+	{
+		// The sRGB curve is too slow to evaluate per channel, so it is looked up from the tone mapped value
+		for (int i = 0; i < TONEMAP_SRGB_TABLE_SIZE; i++)
+		{
+			const float linear = static_cast<float>(i) / (TONEMAP_SRGB_TABLE_SIZE - 1);
+			const float srgb = linear <= 0.0031308f ? 12.92f * linear : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+			m_srgbTable[i] = 255.0f * srgb;
+		}
+
+		// 8x8 Bayer matrix, scaled to offsets in [0, 1) that are added before rounding down. All 3 channels of a pixel
+		// get the same offset, so the rows are stored per float to be indexed straight from the float in the row.
+		for (int y = 0; y < 8; y++)
+		{
+			for (int x = 0; x < 8; x++)
+			{
+				int bayer = 0;
+				for (int bit = 0; bit < 3; bit++)
+				{
+					const int xBit = (x >> bit) & 1;
+					const int yBit = (y >> bit) & 1;
+					bayer |= ((xBit ^ yBit) << (5 - 2 * bit)) | (yBit << (4 - 2 * bit));
+				}
+				for (int channel = 0; channel < 3; channel++)
+				{
+					m_dither[y][3 * x + channel] = (bayer + 0.5f) / 64.0f;
+				}
+			}
+		}
+	}
+
+	void SetExposure(float exposure)
+	{
+		m_exposure = exposure;
+	}
+
+	void SetSimdLevel(SimdLevel simdLevel)
+	{
+		m_simdLevel = std::min(simdLevel, GetSupportedSimdLevel());
+	}
+
+	// Adds rBloomPixels into rPixels in place, leaving the final HDR image there, then writes it tone mapped into
+	// rRgb as 3 bytes a pixel, top row first
+	template <typename ToneMapOperator>
+	void Run(Framebuffer<Vec3f>& rPixels, const Framebuffer<Vec3f>& rBloomPixels, std::vector<uint8_t>& rRgb, ThreadPool& rThreadPool) const
+	{
+		PROFILE_SCOPE("Tone map");
+		const int width = rPixels.GetWidth();
+		const int height = rPixels.GetHeight();
+		const int numOfFloats = width * 3;
+		rRgb.resize(static_cast<size_t>(numOfFloats) * height);
+
+		rThreadPool.ForEachRow(height, [&](int y)
+		{
+			float* pHdr = reinterpret_cast<float*>(rPixels.GetRow(y));
+			const float* pBloom = reinterpret_cast<const float*>(rBloomPixels.GetRow(y));
+			uint8_t* pRgb = &rRgb[static_cast<size_t>(numOfFloats) * y];
+#if defined(SIMD_X86)
+			if (m_simdLevel == enAVX2)
+			{
+				MapRowAVX2<ToneMapOperator>(pHdr, pBloom, pRgb, numOfFloats, y);
+				return;
+			}
+#endif
+			MapRow<ToneMapOperator>(pHdr, pBloom, pRgb, 0, numOfFloats, y);
+		});
+	}
+
+private:
+	// Maps floats [first, last) of a row
+	template <typename ToneMapOperator>
+	void MapRow(float* pHdr, const float* pBloom, uint8_t* pRgb, int first, int last, int y) const
+	{
+		const float* pDither = m_dither[y & 7];
+		for (int i = first; i < last; i++)
+		{
+			const float hdr = pHdr[i] + pBloom[i];
+			pHdr[i] = hdr;
+
+			const float mapped = ToneMapOperator::Apply(hdr * m_exposure);
+			const int tableIndex = static_cast<int>(mapped * (TONEMAP_SRGB_TABLE_SIZE - 1) + 0.5f);
+			pRgb[i] = static_cast<uint8_t>(Clamp(m_srgbTable[tableIndex] + pDither[i % TONEMAP_DITHER_ROW_SIZE], 0.0f, 255.0f));
+		}
+	}
+
+#if defined(SIMD_X86)
+	// Same as MapRow, 8 floats at a time, with MapRow finishing off the end of the row
+	template <typename ToneMapOperator>
+	SIMD_TARGET_AVX2 void MapRowAVX2(float* pHdr, const float* pBloom, uint8_t* pRgb, int numOfFloats, int y) const
+	{
+		const __m256 exposure = _mm256_set1_ps(m_exposure);
+		// 8 floats at a time go through the 24 float dither row in 3 steps, which are rotated round after each use
+		__m256 dither = _mm256_loadu_ps(m_dither[y & 7]);
+		__m256 nextDither = _mm256_loadu_ps(m_dither[y & 7] + 8);
+		__m256 lastDither = _mm256_loadu_ps(m_dither[y & 7] + 16);
+		const __m256 tableScale = _mm256_set1_ps(TONEMAP_SRGB_TABLE_SIZE - 1);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 maxCode = _mm256_set1_ps(255.0f);
+
+		int i = 0;
+		for (; i + 8 <= numOfFloats; i += 8)
+		{
+			const __m256 hdr = _mm256_add_ps(_mm256_loadu_ps(pHdr + i), _mm256_loadu_ps(pBloom + i));
+			_mm256_storeu_ps(pHdr + i, hdr);
+
+			const __m256 mapped = ToneMapOperator::Apply(_mm256_mul_ps(hdr, exposure));
+			const __m256i tableIndex = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(mapped, tableScale), half));
+			__m256 code = _mm256_add_ps(_mm256_i32gather_ps(m_srgbTable, tableIndex, 4), dither);
+			code = _mm256_min_ps(_mm256_max_ps(code, zero), maxCode);
+
+			// Narrow 8 ints to 8 bytes
+			const __m256i codes = _mm256_cvttps_epi32(code);
+			const __m128i codes16 = _mm_packus_epi32(_mm256_castsi256_si128(codes), _mm256_extracti128_si256(codes, 1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(pRgb + i), _mm_packus_epi16(codes16, codes16));
+
+			const __m256 usedDither = dither;
+			dither = nextDither;
+			nextDither = lastDither;
+			lastDither = usedDither;
+		}
+
+		MapRow<ToneMapOperator>(pHdr, pBloom, pRgb, i, numOfFloats, y);
+	}
+#endif
+
+	float m_exposure;
+	SimdLevel m_simdLevel;
+	float m_srgbTable[TONEMAP_SRGB_TABLE_SIZE]; // sRGB code value, 0 to 255, of evenly spaced linear values
+	float m_dither[8][TONEMAP_DITHER_ROW_SIZE];
+};
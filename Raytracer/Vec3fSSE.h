@@ -0,0 +1,108 @@
+#pragma once
+
+#include "MathClass.h"
+#include "Simd.h"
+
+#if defined(SIMD_X86)
+// A Vec3f held in the first three lanes of an SSE register, with the fourth lane kept at 0 so it never affects a dot
+// product. Vec3f itself stays three floats, as framebuffers are read as runs of floats and scene files store it as
+// is, so this is for loops that load a few vectors and then do a lot of maths on them. Every operation rounds the
+// same way as its Vec3f counterpart.
+class Vec3fSSE
+{
+public:
+	Vec3fSSE()
+		:m_value(_mm_setzero_ps())
+	{
+	}
+
+	explicit Vec3fSSE(__m128 value)
+		:m_value(value)
+	{
+	}
+
+	explicit Vec3fSSE(const Vec3f& v)
+		:m_value(_mm_set_ps(0.0f, v.z, v.y, v.x))
+	{
+	}
+
+	Vec3fSSE(float x, float y, float z)
+		:m_value(_mm_set_ps(0.0f, z, y, x))
+	{
+	}
+
+	Vec3f ToVec3f() const
+	{
+		alignas(16) float values[4];
+		_mm_store_ps(values, m_value);
+		return Vec3f(values[0], values[1], values[2]);
+	}
+
+	Vec3fSSE operator+ (const Vec3fSSE& other) const
+	{
+		return Vec3fSSE(_mm_add_ps(m_value, other.m_value));
+	}
+
+	Vec3fSSE operator- (const Vec3fSSE& other) const
+	{
+		return Vec3fSSE(_mm_sub_ps(m_value, other.m_value));
+	}
+
+	Vec3fSSE operator* (const Vec3fSSE& other) const
+	{
+		return Vec3fSSE(_mm_mul_ps(m_value, other.m_value));
+	}
+
+	Vec3fSSE operator* (float scale) const
+	{
+		return Vec3fSSE(_mm_mul_ps(m_value, _mm_set1_ps(scale)));
+	}
+
+	Vec3fSSE& operator+= (const Vec3fSSE& other)
+	{
+		m_value = _mm_add_ps(m_value, other.m_value);
+		return *this;
+	}
+
+	Vec3fSSE& operator*= (const Vec3fSSE& other)
+	{
+		m_value = _mm_mul_ps(m_value, other.m_value);
+		return *this;
+	}
+
+	float dot(const Vec3fSSE& other) const
+	{
+		// (x + y) + (z + 0), the same order Vec3f::dot adds in
+		const __m128 product = _mm_mul_ps(m_value, other.m_value);
+		const __m128 swapped = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1));
+		const __m128 pairSums = _mm_add_ps(product, swapped);
+		return _mm_cvtss_f32(_mm_add_ss(pairSums, _mm_movehl_ps(pairSums, pairSums)));
+	}
+
+	float magnitude() const
+	{
+		return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(dot(*this))));
+	}
+
+	Vec3fSSE normalize() const
+	{
+		const float mag = magnitude();
+		if (mag != 0.0f)
+		{
+			return *this * (1.0f / mag);
+		}
+		return Vec3fSSE();
+	}
+
+	Vec3fSSE cross(const Vec3fSSE& other) const
+	{
+		// a * b.yzx - a.yzx * b gives the cross product in zxy order
+		const __m128 aYZX = _mm_shuffle_ps(m_value, m_value, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 bYZX = _mm_shuffle_ps(other.m_value, other.m_value, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 crossZXY = _mm_sub_ps(_mm_mul_ps(m_value, bYZX), _mm_mul_ps(aYZX, other.m_value));
+		return Vec3fSSE(_mm_shuffle_ps(crossZXY, crossZXY, _MM_SHUFFLE(3, 0, 2, 1)));
+	}
+
+	__m128 m_value;
+};
+#endif // SIMD_X86
@@ -1,43 +1,119 @@
 #include <assert.h> 
+#include <chrono>
+#include <cfloat>
 #include <iostream>
-#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
 #include <vector>
-#include <time.h>
-#include <thread> 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "Materials.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "FastMath.h"
+#include "Sampler.h"
+#include "Scene.h"
+#include "SceneFile.h"
+#include "SceneGenerator.h"
+#include "BVH.h"
+#include "LightSampler.h"
+#include "ThreadPool.h"
+#include "ImageWriter.h"
+#include "Framebuffer.h"
+#include "Bloom.h"
+#include "ToneMap.h"
+#include "Benchmark.h"
+#include "CacheCounters.h"
+#include "Profiler.h"
 
 #define USETHREADS
-#define PROCESSOR_NUM 8
+#define TILE_SIZE 32
+#define RUSSIAN_ROULETTE_DEPTH 3
+#define TONEMAP_OPERATOR ACESToneMap // ACESToneMap, ReinhardToneMap or ExposureToneMap
+#define BENCHMARK_WIDTH 640
+#define BENCHMARK_HEIGHT 360
+#define BENCHMARK_SAMPLES 16
+#define BENCHMARK_REPEATS 3 // The fastest run of each scene and thread count is reported
+
+struct Tile
+{
+	int m_x;
+	int m_y;
+	int m_width;
+	int m_height;
+};
+
+// The order the pixels of a tile are rendered in
+enum TileTraversal
+{
+	enScanlineTraversal,
+	enMortonTraversal, // Along a Morton curve, so pixels close in the image are traced close in time
+	enPacketTraversal, // Along a Morton curve, with the camera rays of each 4x4 block traced as one packet
+	enNumOfTileTraversals
+};
 
-std::vector<Vec3f> g_sectionsPixels[PROCESSOR_NUM];
-std::vector<Vec3f> g_bloomPixels;
-std::vector<Vec3f> g_finalPixels;
+static const char* g_tileTraversalNames[enNumOfTileTraversals] = { "scanline", "morton", "packets" };
 
-std::vector<HitObject*> g_hitObjectsList;
-std::vector<HitObject*> g_lightObjectsList;
+Framebuffer<Vec3f> g_bloomPixels;
+Framebuffer<Vec3f> g_finalPixels;
+Framebuffer<Vec3f> g_accumulatedPixels;
+std::vector<uint8_t> g_outputPixels; // Tone mapped 8 bit sRGB
+
+// Running luminance statistics of a pixel's samples, used to stop sampling once the pixel has converged
+struct PixelStatistics
+{
+	int m_numOfSamples;
+	float m_mean;
+	float m_sumOfSquaredDifferences;
+	bool m_isConverged;
+};
+Framebuffer<PixelStatistics> g_pixelStatistics;
+
+Scene g_scene;
+BloomPass g_bloom;
+ToneMapper g_toneMapper;
+BVH g_bvh;
+LightSampler g_lightSampler;
 Camera g_camera;
+uint64_t g_renderSeed = 0;
+SamplerType g_samplerType = enRandomSampler; // Where the pixel, lens, scatter and light sample numbers come from
+SampleSequence g_sampleSequence;
+int g_maxRayDepth = 50;
+int g_antialisingSamples = 100;
+int g_numOfShadowRays = 2; // Per bounce
+bool g_isProgressive = false;
+int g_snapshotInterval = 0; // Progressive passes between snapshots, 0 to only save the final image
+bool g_isAdaptive = false;
+float g_adaptiveThreshold = 0.02f; // Relative standard error a pixel has to get under to stop sampling
+int g_minAdaptiveSamples = 16;
+bool g_isWavefront = false; // Trace tiles a wave of paths at a time instead of one path at a time
+TileTraversal g_tileTraversal = enPacketTraversal;
+bool g_isSavingHdr = false; // Also write the untonemapped image as RaytracedOutput.pfm
+bool g_isProfiling = false; // Write the counters and stage timings to Profile.json and ProfileTrace.json
+int g_numOfAnimationFrames = 0; // 0 renders a single image
+float g_animationOrbitDegrees = 90.0f; // How far the camera swings around the scene over the animation
+
+bool HasHit(const Ray& r, float minHitDistance, float maxHitDistance, HitRecord& rHitRecord)
+{
+	return g_bvh.HasHit(r, minHitDistance, maxHitDistance, rHitRecord);
+}
 
-bool HasHit(Ray r, float minHitDistance, float maxHitDistance, HitRecord& rHitRecord)
+bool IsOccluded(const Ray& r, float minHitDistance, float maxHitDistance)
 {
-	bool hasHit = false;
-	float closestHitDistance = maxHitDistance;
-	for (HitObject* pHitObject : g_hitObjectsList)
-	{
-		if (pHitObject->HasHit(r, minHitDistance, closestHitDistance, rHitRecord))
-		{
-			hasHit = true;
-		}
-	}
-	return hasHit;
+	PROFILE_COUNT(enShadowRays, 1);
+	return g_bvh.IsOccluded(r, minHitDistance, maxHitDistance);
 }
 
-Vec3f CalcLighting(HitObject* pLightObject, HitRecord hitRecord, float distanceToLight)
+Vec3f CalcLighting(HitObject* pLightObject, const HitRecord& hitRecord, float distanceToLight)
 {
 	Vec3f lightColour = Vec3f(0.0f, 0.0f, 0.0f);
-	Vec3f lightDir = (pLightObject->m_position - hitRecord.m_intersectPoint).normalize();
-	Vec3f attenuatedLightColour = LERP(pLightObject->m_pMaterial->m_diffuseColour, Vec3f(0.0f, 0.0f, 0.0f), distanceToLight / static_cast<LightSphere*>(pLightObject)->m_lightRadius);
+	Vec3f lightDir;
+	Vec3f halfVector;
+	GetShadingLightAndHalfVectors(hitRecord.m_intersectPoint, pLightObject->m_position, g_camera.GetPosition(), lightDir, halfVector);
+	Vec3f attenuatedLightColour = LERP(g_scene.m_materials[pLightObject->m_materialIndex].m_diffuseColour, Vec3f(0.0f, 0.0f, 0.0f), distanceToLight / static_cast<LightSphere*>(pLightObject)->m_lightRadius);
 
 	// Diffuse light
 	{
@@ -48,9 +124,7 @@ Vec3f CalcLighting(HitObject* pLightObject, HitRecord hitRecord, float distanceT
 
 	// Specular light
 	{
-		Vec3f v = (g_camera.GetPosition() - hitRecord.m_intersectPoint).normalize();
-		Vec3f h = (lightDir + v).normalize();
-		float specularLightIntensity = powf(hitRecord.m_normal.dot(h), hitRecord.m_pMaterial->m_shininess);
+		float specularLightIntensity = ShadingPow(hitRecord.m_normal.dot(halfVector), g_scene.m_materials[hitRecord.m_materialIndex].m_shininess);
 		specularLightIntensity = std::max(0.0f, specularLightIntensity);
 		lightColour += attenuatedLightColour * specularLightIntensity * static_cast<LightSphere*>(pLightObject)->m_lightIntensity;
 	}
@@ -58,472 +132,1237 @@ Vec3f CalcLighting(HitObject* pLightObject, HitRecord hitRecord, float distanceT
 	return lightColour;
 }
 
-Vec3f GetRaytracedColor(Ray r, int depth)
+// Picks a random point inside the light and makes the shadow ray towards it. rMaxHitDistance is where the ray enters
+// the light, anything hit before that is in the way. Returns false if the hit point is inside the light itself,
+// which is always lit and needs no ray.
+bool MakeShadowRay(const HitRecord& hitRecord, LightSphere* pLight, Sampler& rSampler, Ray& rShadowRay, float& rMaxHitDistance)
 {
-	HitRecord hitRecord;
-	if (HasHit(r, 0.001f, INT_MAX, hitRecord))
+	Vec3f randomLightPos = rSampler.GetPointInUnitSphere() * pLight->m_radius + pLight->m_position;
+	Vec3f toLight = randomLightPos - hitRecord.m_intersectPoint;
+
+	Vec3f lightToOrigin = hitRecord.m_intersectPoint - pLight->m_position;
+	const float a = toLight.dot(toLight);
+	const float b = lightToOrigin.dot(toLight);
+	const float c = lightToOrigin.dot(lightToOrigin) - pLight->m_radius * pLight->m_radius;
+	if (c <= 0.0f)
 	{
-		Ray scattered;
-		if (depth < 50 && hitRecord.m_pMaterial->Scatter(r, hitRecord, scattered))
-		{
-			Vec3f lightColour = Vec3f(0.0f, 0.0f, 0.0f);
-			if (hitRecord.m_pMaterial->m_materialType == MaterialType::enEmmisive)
-			{
-				Emmisive* pEmmisive = static_cast<Emmisive*>(hitRecord.m_pMaterial);
-				return pEmmisive->m_diffuseColour * pEmmisive->m_exposure;
-			}
-			else
-			{
-				float shadowMultiply = 1.0f;
-				for (HitObject* pLightObject : g_lightObjectsList)
-				{
-					float distanceToLight = (hitRecord.m_intersectPoint - pLightObject->m_position).magnitude();
-					if (distanceToLight <= static_cast<LightSphere*>(pLightObject)->m_lightRadius)
-					{
-						Ray shadowRay = Ray(hitRecord.m_intersectPoint, pLightObject->m_position - hitRecord.m_intersectPoint);
-						HitRecord shadowHitRecord;
-						if (HasHit(shadowRay, 0.001f, distanceToLight, shadowHitRecord))
-						{
-							float shadowDistanceToLight = (shadowHitRecord.m_intersectPoint - pLightObject->m_position).magnitude();
-							if (shadowDistanceToLight <= static_cast<LightSphere*>(pLightObject)->m_radius)
-							{
-								lightColour += CalcLighting(pLightObject, hitRecord, distanceToLight);
-							}
-							else
-							{
-								float softShadowMultiply = 0.0f;
-								const int numOfSoftShadowSamples = 100;
-								int numOfSamplesToAverage = 0;
-								for (int s = 0; s < numOfSoftShadowSamples; s++)
-								{
-									Vec3f randomLightPos = GetRandomUnitVecInSphere() * static_cast<LightSphere*>(pLightObject)->m_radius + pLightObject->m_position;
-									Ray softShadowRay = Ray(hitRecord.m_intersectPoint, randomLightPos - hitRecord.m_intersectPoint);
-									float softShadowRayMaxHitDistance = (randomLightPos - hitRecord.m_intersectPoint).magnitude();
-									HitRecord softShadowHitRecord;
-									if (HasHit(softShadowRay, 0.001f, softShadowRayMaxHitDistance, softShadowHitRecord))
-									{
-										float shadowDistanceToLight = (softShadowHitRecord.m_intersectPoint - randomLightPos).magnitude();
-										if (shadowDistanceToLight <= static_cast<LightSphere*>(pLightObject)->m_radius)
-										{
-											lightColour += CalcLighting(pLightObject, hitRecord, distanceToLight);
-											softShadowMultiply += 1.0f;
-											numOfSamplesToAverage++;
-										}
-										else
-										{
-											softShadowMultiply += 0.2f;
-											numOfSamplesToAverage++;
-										}
-									}
-								}
-
-								lightColour.r /= numOfSamplesToAverage;
-								lightColour.g /= numOfSamplesToAverage;
-								lightColour.b /= numOfSamplesToAverage;
-
-								softShadowMultiply /= numOfSamplesToAverage;
-
-								shadowMultiply *= softShadowMultiply;
-								shadowMultiply = LERP(shadowMultiply, 1.0f, distanceToLight / static_cast<LightSphere*>(pLightObject)->m_lightRadius);
-							}
-						}
-					}
-				}
-				return (Vec3f(0.8f, 0.8f, 0.8f) + lightColour) * hitRecord.m_pMaterial->m_diffuseColour * GetRaytracedColor(scattered, depth + 1) * shadowMultiply;
-			}
-		}
-		else
-		{
-			return Vec3f(0.0f, 0.0f, 0.0f);
-		}
+		return false;
 	}
 
-	return Vec3f(1.0f, 1.0f, 1.0f);
+	// Stops a little short so the light itself never counts as a blocker
+	rMaxHitDistance = (-b - sqrtf(std::max(0.0f, b * b - a * c))) / a * 0.999f;
+	rShadowRay = Ray(hitRecord.m_intersectPoint, toLight);
+	return true;
+}
+
+// Lighting from pLight once numOfVisibleSamples of the g_numOfShadowRays shadow rays towards it got through.
+// lightWeight is the weight g_lightSampler gave pLight for standing in for all the lights.
+Vec3f GetShadowedLighting(const HitRecord& hitRecord, LightSphere* pLight, float lightWeight, int numOfVisibleSamples, float& rShadowMultiply)
+{
+	const float distanceToLight = (hitRecord.m_intersectPoint - pLight->m_position).magnitude();
+	const float visibility = static_cast<float>(numOfVisibleSamples) / static_cast<float>(g_numOfShadowRays);
+
+	// Blocked shadow rays still let a fifth of the light through, and shadows fade out towards the edge of the light's range
+	const float shadow = LERP(0.2f + 0.8f * visibility, 1.0f, distanceToLight / pLight->m_lightRadius);
+
+	// Every light in range used to cast its own shadow and the shadows multiplied together, which is exp of the sum
+	// of their logs. Weighting the log of this one light's shadow makes the exponent an unbiased estimate of that
+	// sum, like the weight does for the lighting. With a single light it is exactly its shadow. With several, the
+	// average of the exp comes out above the product, so their combined shadows are lighter than they used to be.
+	rShadowMultiply = powf(shadow, lightWeight);
+
+	return CalcLighting(pLight, hitRecord, distanceToLight) * (visibility * lightWeight);
 }
 
-void CreateImageSection(int bottomLeftPixelX, int bottomLeftPixelY, int sectionWidth, int sectionHeight, int finalWidth, int finalHeight, int sectionNumber)
+// Light reaching a hit point from the light spheres, estimated from one light picked by g_lightSampler and a few
+// shadow rays to random points inside it. rShadowMultiply, which darkens everything the path picks up after this
+// bounce, is estimated from that one light's shadow too, see GetShadowedLighting.
+Vec3f GetDirectLighting(const HitRecord& hitRecord, float& rShadowMultiply, Sampler& rSampler)
 {
-	const int antialisingSamples = 100;
+	rShadowMultiply = 1.0f;
+
+	float lightWeight = 0.0f;
+	LightSphere* pLight = g_lightSampler.Sample(hitRecord.m_intersectPoint, rSampler.GetRandom(), lightWeight);
+	if (pLight == nullptr)
+	{
+		return Vec3f(0.0f, 0.0f, 0.0f);
+	}
 
-	for (int i = sectionHeight + bottomLeftPixelY; bottomLeftPixelY <= i; i--)
+	int numOfVisibleSamples = 0;
+	for (int s = 0; s < g_numOfShadowRays; s++)
 	{
-		for (int j = bottomLeftPixelX; j < sectionWidth + bottomLeftPixelX; j++)
+		Ray shadowRay;
+		float shadowRayMaxHitDistance = 0.0f;
+		if (!MakeShadowRay(hitRecord, pLight, rSampler, shadowRay, shadowRayMaxHitDistance) || !IsOccluded(shadowRay, 0.001f, shadowRayMaxHitDistance))
 		{
-			Vec3f col(0.0f, 0.0f, 0.0f);
-			for (int k = 0; k < antialisingSamples; k++)
-			{
-				const float randomU = GetRandomNum();
-				const float randomV = GetRandomNum();
-				float u = static_cast<float>(j + randomU) / static_cast<float>(finalWidth + randomU);
-				float v = static_cast<float>(i + randomV) / static_cast<float>(finalHeight + randomV);
+			numOfVisibleSamples++;
+		}
+	}
 
-				Ray r = g_camera.CastRay(u, v);
-				col += GetRaytracedColor(r, 0);
-			}
+	return GetShadowedLighting(hitRecord, pLight, lightWeight, numOfVisibleSamples, rShadowMultiply);
+}
 
-			col.r /= static_cast<float>(antialisingSamples);
-			col.g /= static_cast<float>(antialisingSamples);
-			col.b /= static_cast<float>(antialisingSamples);
+// Folds the colour picked up at a bounce into the path throughput, then plays Russian roulette with the path.
+// Returns false if the path was killed.
+bool UpdateThroughput(Vec3f& rThroughput, const Material& material, const Vec3f& lightColour, float shadowMultiply, int depth, Random& rRandom)
+{
+	rThroughput *= (Vec3f(0.8f, 0.8f, 0.8f) + lightColour) * material.m_diffuseColour * shadowMultiply;
 
-			g_sectionsPixels[sectionNumber].push_back(col);
+	// Kill the path with probability 1 - survival and boost the ones that survive, which keeps the average the same
+	if (depth >= RUSSIAN_ROULETTE_DEPTH)
+	{
+		const float survival = std::min(1.0f, std::max(rThroughput.r, std::max(rThroughput.g, rThroughput.b)));
+		if (rRandom.NextFloat() >= survival)
+		{
+			return false;
 		}
+		rThroughput *= 1.0f / survival;
 	}
+	return true;
 }
 
-void CreateFinalImage(int sectionWidth, int sectionHeight, int finalWidth, int finalHeight, int sectionRows, int sectionColumns)
+// Traces a path through the scene, starting from hasHit and hitRecord of its first ray r. The colour picked up at
+// every bounce is folded into a running throughput instead of recursing, and once a path carries little energy
+// Russian roulette ends it early.
+Vec3f TracePathFromFirstHit(Ray r, Sampler& rSampler, bool hasHit, HitRecord hitRecord)
 {
-	int sectionNumber = 0;
-	int sectionPixelNumber = 0;
-	int pixelX = 0;
-	int pixelY = sectionHeight;
-	int currentSectionRow = 0;
-	while (true)
+	Vec3f throughput(1.0f, 1.0f, 1.0f);
+	for (int depth = 0; ; depth++)
 	{
-		if (pixelX >= finalWidth)
+		if (depth > 0)
 		{
-			pixelX = 0;
-			pixelY--;
-
-			if (pixelY < 0)
-			{
-				pixelY = sectionHeight;
-				currentSectionRow++;
-			}
-
-			if (currentSectionRow == sectionRows)
-			{
-				// Done!
-				break;
-			}
-
-			sectionPixelNumber = sectionWidth * (sectionHeight - pixelY);
-			sectionNumber = currentSectionRow * sectionColumns;
+			PROFILE_COUNT(enBounceRays, 1);
+			hasHit = HasHit(r, 0.001f, FLT_MAX, hitRecord);
 		}
-		else if (pixelX == sectionWidth || (pixelX % sectionWidth == 0 && pixelX >= sectionWidth))
+		if (!hasHit)
 		{
-			sectionNumber++;
-			sectionPixelNumber = sectionWidth * (sectionHeight - pixelY);
+			return throughput;
 		}
 
-		g_finalPixels.push_back(g_sectionsPixels[sectionNumber][sectionPixelNumber]);
+		const Material& material = g_scene.m_materials[hitRecord.m_materialIndex];
 
-		if (g_sectionsPixels[sectionNumber][sectionPixelNumber].magnitude() > 2.0f)
+		Ray scattered;
+		if (depth >= g_maxRayDepth || !Scatter(material, r, hitRecord, scattered, rSampler))
 		{
-			g_bloomPixels.push_back(g_sectionsPixels[sectionNumber][sectionPixelNumber]);
+			return Vec3f(0.0f, 0.0f, 0.0f);
 		}
-		else
+
+		if (material.m_materialType == enEmmisive)
 		{
-			g_bloomPixels.push_back(Vec3f(0.0f, 0.0f, 0.0f));
+			return throughput * material.m_diffuseColour * material.m_exposure;
 		}
 
-		pixelX++;
-		sectionPixelNumber++;
+		float shadowMultiply = 1.0f;
+		Vec3f lightColour = GetDirectLighting(hitRecord, shadowMultiply, rSampler);
+		if (!UpdateThroughput(throughput, material, lightColour, shadowMultiply, depth, rSampler.GetRandom()))
+		{
+			return Vec3f(0.0f, 0.0f, 0.0f);
+		}
+
+		r = scattered;
 	}
 }
 
-std::vector<Vec3f> UpscaleImage(int oldWidth, int oldHeight, int newWidth, int newHeight, std::vector<Vec3f> pixels)
+Vec3f GetRaytracedColor(const Ray& r, Sampler& rSampler)
 {
-	assert(oldWidth < newWidth);
-	assert(oldHeight < newHeight);
+	HitRecord hitRecord;
+	PROFILE_COUNT(enPrimaryRays, 1);
+	const bool hasHit = HasHit(r, 0.001f, FLT_MAX, hitRecord);
+	return TracePathFromFirstHit(r, rSampler, hasHit, hitRecord);
+}
 
-	const float scaledownWidth = static_cast<float>(oldWidth) / static_cast<float>(newWidth);
-	const float scaledownHeight = static_cast<float>(oldHeight) / static_cast<float>(newHeight);
-	const float scaleupWidth = static_cast<float>(newWidth) / static_cast<float>(oldWidth);
-	const float scaleupHeight = static_cast<float>(newHeight) / static_cast<float>(oldHeight);
+// Seeded by pixel and sample so the image doesn't depend on which thread rendered the tile, on how the samples
+// were split into passes, or on the order paths were traced in
+Sampler GetPixelSampler(int x, int y, int finalWidth, int sample)
+{
+	return Sampler(g_sampleSequence, x, y, HashSeed(g_renderSeed, x + (finalWidth * y)), sample);
+}
+
+// Camera ray through a random point of pixel (x, y), with rows counting down from the top of the image
+Ray CastPixelRay(int x, int y, int finalWidth, int finalHeight, Sampler& rSampler)
+{
+	const int i = finalHeight - 1 - y;
+	float randomU = 0.0f;
+	float randomV = 0.0f;
+	rSampler.Get2D(randomU, randomV);
+	float u = static_cast<float>(x + randomU) / static_cast<float>(finalWidth + randomU);
+	float v = static_cast<float>(i + randomV) / static_cast<float>(finalHeight + randomV);
+	return g_camera.CastRay(u, v, rSampler);
+}
+
+// Adds a sample to g_accumulatedPixels and updates the pixel's statistics
+void AddPixelSample(int x, int y, const Vec3f& sample)
+{
+	PROFILE_COUNT(enSamples, 1);
+	g_accumulatedPixels.At(x, y) += sample;
+
+	// Welford's online variance
+	PixelStatistics& rStatistics = g_pixelStatistics.At(x, y);
+	const float luminance = 0.2126f * sample.r + 0.7152f * sample.g + 0.0722f * sample.b;
+	rStatistics.m_numOfSamples++;
+	const float delta = luminance - rStatistics.m_mean;
+	rStatistics.m_mean += delta / rStatistics.m_numOfSamples;
+	rStatistics.m_sumOfSquaredDifferences += delta * (luminance - rStatistics.m_mean);
+
+	if (g_isAdaptive && rStatistics.m_numOfSamples >= g_minAdaptiveSamples)
+	{
+		const float variance = rStatistics.m_sumOfSquaredDifferences / (rStatistics.m_numOfSamples - 1);
+		const float standardError = sqrtf(variance / rStatistics.m_numOfSamples);
+		// The 0.1 floor stops near black pixels from needing an impossibly small absolute error
+		rStatistics.m_isConverged = standardError / (rStatistics.m_mean + 0.1f) < g_adaptiveThreshold;
+	}
+}
 
-	std::vector<Vec3f> upscaledPixels;
+// Every other bit of value, starting from bit 0, packed into the low 16 bits
+uint32_t CompactEvenBits(uint32_t value)
+{
+	value &= 0x55555555;
+	value = (value | (value >> 1)) & 0x33333333;
+	value = (value | (value >> 2)) & 0x0f0f0f0f;
+	value = (value | (value >> 4)) & 0x00ff00ff;
+	value = (value | (value >> 8)) & 0x0000ffff;
+	return value;
+}
 
-	for (int y = 0; y < newHeight; y++)
+// Pixel (rX, rY) of a tile at position index along its Morton curve, the index with the bits of x and y interleaved.
+// Returns false for the positions outside a tile cut short by the edge of the image.
+bool GetTilePixel(const Tile& tile, int index, int& rX, int& rY)
+{
+	if (g_tileTraversal == enScanlineTraversal)
 	{
-		for (int x = 0; x < newWidth; x++)
+		rX = tile.m_x + index % TILE_SIZE;
+		rY = tile.m_y + index / TILE_SIZE;
+	}
+	else
+	{
+		rX = tile.m_x + static_cast<int>(CompactEvenBits(static_cast<uint32_t>(index)));
+		rY = tile.m_y + static_cast<int>(CompactEvenBits(static_cast<uint32_t>(index) >> 1));
+	}
+	return rX < tile.m_x + tile.m_width && rY < tile.m_y + tile.m_height;
+}
+
+// Adds samples [firstSample, firstSample + numOfSamples) of every pixel in the tile to g_accumulatedPixels,
+// tracing each path to the end before starting the next
+void RenderTile(const Tile& tile, int finalWidth, int finalHeight, int firstSample, int numOfSamples)
+{
+	for (int index = 0; index < TILE_SIZE * TILE_SIZE; index++)
+	{
+		int x = 0;
+		int y = 0;
+		if (!GetTilePixel(tile, index, x, y))
+		{
+			continue;
+		}
+
+		for (int k = firstSample; k < firstSample + numOfSamples && !g_pixelStatistics.At(x, y).m_isConverged; k++)
+		{
+			Sampler sampler = GetPixelSampler(x, y, finalWidth, k);
+			Ray r = CastPixelRay(x, y, finalWidth, finalHeight, sampler);
+			AddPixelSample(x, y, GetRaytracedColor(r, sampler));
+		}
+	}
+}
+
+// Same as RenderTile, but every run of RAY_PACKET_SIZE pixels along the Morton curve is a 4x4 block, and each
+// sample of the block starts with its camera rays traced through the BVH as one packet. The paths then carry on
+// one at a time, as their bounces go off in all directions.
+void RenderTilePackets(const Tile& tile, int finalWidth, int finalHeight, int firstSample, int numOfSamples)
+{
+	for (int blockStart = 0; blockStart < TILE_SIZE * TILE_SIZE; blockStart += RAY_PACKET_SIZE)
+	{
+		for (int k = firstSample; k < firstSample + numOfSamples; k++)
 		{
-			int aPixelX = static_cast<int>(scaledownWidth * x);
-			int aPixelY = static_cast<int>(scaledownHeight * y);
-			int bPixelX = aPixelX + 1;
-			int cPixelY = aPixelY + 1;
-			
-			int index = aPixelX + (oldWidth * aPixelY);
-			int maxIndex = index + oldWidth + 1;
-			if (maxIndex < pixels.size())
+			Sampler samplers[RAY_PACKET_SIZE];
+			Ray rays[RAY_PACKET_SIZE];
+			int pixelXs[RAY_PACKET_SIZE];
+			int pixelYs[RAY_PACKET_SIZE];
+			int numOfRays = 0;
+			for (int index = blockStart; index < blockStart + RAY_PACKET_SIZE; index++)
 			{
-				Vec3f a = pixels[index];
-				Vec3f b = pixels[index + 1];
-				Vec3f c = pixels[index + oldWidth];
-				Vec3f d = pixels[maxIndex];
-
-				float tx = (x - (aPixelX * scaleupWidth)) / ((bPixelX * scaleupWidth) - (aPixelX * scaleupWidth));
-				float ty = (y - (aPixelY * scaleupHeight)) / ((cPixelY * scaleupHeight) - (aPixelY * scaleupHeight));
-				Vec3f ab = LERP(a, b, tx);
-				Vec3f cd = LERP(c, d, tx);
-				Vec3f final = LERP(ab, cd, ty);
-				upscaledPixels.push_back(final);
+				int x = 0;
+				int y = 0;
+				if (!GetTilePixel(tile, index, x, y) || g_pixelStatistics.At(x, y).m_isConverged)
+				{
+					continue;
+				}
+				samplers[numOfRays] = GetPixelSampler(x, y, finalWidth, k);
+				rays[numOfRays] = CastPixelRay(x, y, finalWidth, finalHeight, samplers[numOfRays]);
+				pixelXs[numOfRays] = x;
+				pixelYs[numOfRays] = y;
+				numOfRays++;
+			}
+			if (numOfRays == 0)
+			{
+				break; // Every pixel of the block has converged, or is off the edge of the image
+			}
+
+			HitRecord hitRecords[RAY_PACKET_SIZE];
+			bool hasHits[RAY_PACKET_SIZE];
+			PROFILE_COUNT(enPrimaryRays, numOfRays);
+			g_bvh.HasHitPacket(rays, numOfRays, 0.001f, FLT_MAX, hitRecords, hasHits);
+			for (int i = 0; i < numOfRays; i++)
+			{
+				AddPixelSample(pixelXs[i], pixelYs[i], TracePathFromFirstHit(rays[i], samplers[i], hasHits[i], hitRecords[i]));
 			}
 		}
 	}
-
-	return upscaledPixels;
 }
 
-std::vector<Vec3f> DownscaleImage(int oldWidth, int oldHeight, int newWidth, int newHeight, std::vector<Vec3f> pixels)
+// One path in wavefront mode, carried over from one wave to the next
+struct WavefrontPath
 {
-	assert(oldWidth > newWidth);
-	assert(oldHeight > newHeight);
+	explicit WavefrontPath(const Sampler& sampler)
+		:m_sampler(sampler)
+	{
+	}
 
-	const float scaledownWidth = static_cast<float>(newWidth) / static_cast<float>(oldWidth);
-	const float scaledownHeight = static_cast<float>(newHeight) / static_cast<float>(oldHeight);
+	Ray m_ray;
+	Vec3f m_throughput;
+	Sampler m_sampler;
+	HitRecord m_hitRecord;
+	LightSphere* m_pLight;
+	float m_lightWeight;
+	int m_numOfVisibleSamples;
+	int m_x;
+	int m_y;
+	int m_depth;
+};
+
+struct WavefrontShadowRay
+{
+	Ray m_ray;
+	float m_maxHitDistance;
+	int m_pathIndex;
+};
 
-	std::vector<Vec3f> downscaledPixels;
+// Queues of one render thread, kept from tile to tile so the waves don't allocate once they have grown
+struct WavefrontQueues
+{
+	std::vector<WavefrontPath> m_paths;
+	std::vector<Vec3f> m_colours; // Final colour of each path
+	std::vector<int> m_activePaths;
+	std::vector<int> m_hitPaths;
+	std::vector<int> m_sortedPaths;
+	std::vector<int> m_shadedPaths;
+	std::vector<WavefrontShadowRay> m_shadowRays;
+};
+std::vector<WavefrontQueues> g_wavefrontQueues; // One per render thread
+
+// Same paths as RenderTile, but traced breadth first. Every sample starts a wave of one path per pixel of the tile,
+// then each step intersects the whole wave, sorts the hits by material type, shades them a material at a time,
+// traces all the queued shadow rays and moves the surviving paths on to the next wave. Each path keeps its own
+// sampler and takes its numbers in the same order as GetRaytracedColor, so the image is the same either way.
+void RenderTileWavefront(const Tile& tile, int finalWidth, int finalHeight, int firstSample, int numOfSamples, WavefrontQueues& rQueues)
+{
+	const int numOfMaterialTypes = enEmmisive + 1;
+	std::vector<WavefrontPath>& rPaths = rQueues.m_paths;
+	std::vector<Vec3f>& rColours = rQueues.m_colours;
 
-	for (int y = 0; y < oldHeight; y++)
+	for (int k = firstSample; k < firstSample + numOfSamples; k++)
 	{
-		for (int x = 0; x < oldWidth; x++)
+		rPaths.clear();
+		rColours.clear();
+		rQueues.m_activePaths.clear();
+		for (int index = 0; index < TILE_SIZE * TILE_SIZE; index++)
 		{
-			Vec3f downscaledPixel;
+			int x = 0;
+			int y = 0;
+			if (!GetTilePixel(tile, index, x, y) || g_pixelStatistics.At(x, y).m_isConverged)
+			{
+				continue;
+			}
 
-			const int pixelX = static_cast<int>(scaledownWidth * x);
-			const int pixelY = static_cast<int>(scaledownHeight * y);
+			WavefrontPath path(GetPixelSampler(x, y, finalWidth, k));
+			path.m_ray = CastPixelRay(x, y, finalWidth, finalHeight, path.m_sampler);
+			path.m_throughput = Vec3f(1.0f, 1.0f, 1.0f);
+			path.m_x = x;
+			path.m_y = y;
+			path.m_depth = 0;
+			rQueues.m_activePaths.push_back(static_cast<int>(rPaths.size()));
+			rPaths.push_back(path);
+			rColours.push_back(Vec3f(0.0f, 0.0f, 0.0f));
+		}
 
-			int oldIndex = x + (oldWidth * y);
-			int newIndex = pixelX + (newWidth * pixelY);
+		if (rPaths.empty())
+		{
+			break; // Every pixel of the tile has converged
+		}
 
-			if (newIndex < downscaledPixels.size())
+		while (!rQueues.m_activePaths.empty())
+		{
+			// Closest hits of the whole wave. Paths that miss pick up the sky, paths past the depth limit stay black.
+			// The first wave is in Morton order, so with packets its runs of RAY_PACKET_SIZE paths are 4x4 blocks
+			// of camera rays and are traced together.
+			rQueues.m_hitPaths.clear();
+			const bool isPacketWave = g_tileTraversal == enPacketTraversal && rPaths[rQueues.m_activePaths[0]].m_depth == 0;
+			const int numOfActivePaths = static_cast<int>(rQueues.m_activePaths.size());
+			for (int first = 0; first < numOfActivePaths; )
 			{
-				downscaledPixels[newIndex] += pixels[oldIndex];
+				const int numOfRays = isPacketWave ? std::min(RAY_PACKET_SIZE, numOfActivePaths - first) : 1;
+				const int* pPathIndices = &rQueues.m_activePaths[first];
+				bool hasHits[RAY_PACKET_SIZE];
+				if (isPacketWave)
+				{
+					Ray rays[RAY_PACKET_SIZE];
+					HitRecord hitRecords[RAY_PACKET_SIZE];
+					for (int i = 0; i < numOfRays; i++)
+					{
+						rays[i] = rPaths[pPathIndices[i]].m_ray;
+					}
+					g_bvh.HasHitPacket(rays, numOfRays, 0.001f, FLT_MAX, hitRecords, hasHits);
+					for (int i = 0; i < numOfRays; i++)
+					{
+						rPaths[pPathIndices[i]].m_hitRecord = hitRecords[i];
+					}
+				}
+				else
+				{
+					hasHits[0] = HasHit(rPaths[pPathIndices[0]].m_ray, 0.001f, FLT_MAX, rPaths[pPathIndices[0]].m_hitRecord);
+				}
+
+				for (int i = 0; i < numOfRays; i++)
+				{
+					const int pathIndex = pPathIndices[i];
+					WavefrontPath& rPath = rPaths[pathIndex];
+					PROFILE_COUNT(rPath.m_depth == 0 ? enPrimaryRays : enBounceRays, 1);
+					if (!hasHits[i])
+					{
+						rColours[pathIndex] = rPath.m_throughput;
+					}
+					else if (rPath.m_depth < g_maxRayDepth)
+					{
+						rQueues.m_hitPaths.push_back(pathIndex);
+					}
+				}
+				first += numOfRays;
+			}
+
+			// Counting sort by material type, so each run of paths takes the same branch through Scatter
+			int typeStarts[numOfMaterialTypes + 1] = {};
+			for (int pathIndex : rQueues.m_hitPaths)
+			{
+				typeStarts[g_scene.m_materials[rPaths[pathIndex].m_hitRecord.m_materialIndex].m_materialType + 1]++;
+			}
+			for (int type = 0; type < numOfMaterialTypes; type++)
+			{
+				typeStarts[type + 1] += typeStarts[type];
 			}
-			else
+			rQueues.m_sortedPaths.resize(rQueues.m_hitPaths.size());
+			for (int pathIndex : rQueues.m_hitPaths)
 			{
-				downscaledPixels.push_back(pixels[oldIndex]);
+				rQueues.m_sortedPaths[typeStarts[g_scene.m_materials[rPaths[pathIndex].m_hitRecord.m_materialIndex].m_materialType]++] = pathIndex;
 			}
+
+			// Scatter, pick a light and queue the shadow rays towards it
+			rQueues.m_shadedPaths.clear();
+			rQueues.m_shadowRays.clear();
+			for (int pathIndex : rQueues.m_sortedPaths)
+			{
+				WavefrontPath& rPath = rPaths[pathIndex];
+				const Material& material = g_scene.m_materials[rPath.m_hitRecord.m_materialIndex];
+
+				Ray scattered;
+				if (!Scatter(material, rPath.m_ray, rPath.m_hitRecord, scattered, rPath.m_sampler))
+				{
+					continue;
+				}
+
+				if (material.m_materialType == enEmmisive)
+				{
+					rColours[pathIndex] = rPath.m_throughput * material.m_diffuseColour * material.m_exposure;
+					continue;
+				}
+
+				rPath.m_ray = scattered;
+				rPath.m_numOfVisibleSamples = 0;
+				rPath.m_pLight = g_lightSampler.Sample(rPath.m_hitRecord.m_intersectPoint, rPath.m_sampler.GetRandom(), rPath.m_lightWeight);
+				if (rPath.m_pLight != nullptr)
+				{
+					for (int s = 0; s < g_numOfShadowRays; s++)
+					{
+						WavefrontShadowRay shadowRay;
+						shadowRay.m_pathIndex = pathIndex;
+						if (MakeShadowRay(rPath.m_hitRecord, rPath.m_pLight, rPath.m_sampler, shadowRay.m_ray, shadowRay.m_maxHitDistance))
+						{
+							rQueues.m_shadowRays.push_back(shadowRay);
+						}
+						else
+						{
+							rPath.m_numOfVisibleSamples++;
+						}
+					}
+				}
+				rQueues.m_shadedPaths.push_back(pathIndex);
+			}
+
+			for (const WavefrontShadowRay& shadowRay : rQueues.m_shadowRays)
+			{
+				if (!IsOccluded(shadowRay.m_ray, 0.001f, shadowRay.m_maxHitDistance))
+				{
+					rPaths[shadowRay.m_pathIndex].m_numOfVisibleSamples++;
+				}
+			}
+
+			// Fold in the lighting and carry the paths that survive on to the next wave
+			rQueues.m_activePaths.clear();
+			for (int pathIndex : rQueues.m_shadedPaths)
+			{
+				WavefrontPath& rPath = rPaths[pathIndex];
+				float shadowMultiply = 1.0f;
+				Vec3f lightColour(0.0f, 0.0f, 0.0f);
+				if (rPath.m_pLight != nullptr)
+				{
+					lightColour = GetShadowedLighting(rPath.m_hitRecord, rPath.m_pLight, rPath.m_lightWeight, rPath.m_numOfVisibleSamples, shadowMultiply);
+				}
+
+				if (UpdateThroughput(rPath.m_throughput, g_scene.m_materials[rPath.m_hitRecord.m_materialIndex], lightColour, shadowMultiply, rPath.m_depth, rPath.m_sampler.GetRandom()))
+				{
+					rPath.m_depth++;
+					rQueues.m_activePaths.push_back(pathIndex);
+				}
+			}
+		}
+
+		for (size_t pathIndex = 0; pathIndex < rPaths.size(); pathIndex++)
+		{
+			AddPixelSample(rPaths[pathIndex].m_x, rPaths[pathIndex].m_y, rColours[pathIndex]);
 		}
 	}
+}
 
-	const int gridSampleWidth = oldWidth / newWidth;
-	const int gridSampleHeight = oldHeight / newHeight;
-	const int gridSampleSize = gridSampleWidth * gridSampleHeight;
+void RenderTileSamples(const Tile& tile, int finalWidth, int finalHeight, int firstSample, int numOfSamples, int threadIndex)
+{
+	if (g_isWavefront)
+	{
+		RenderTileWavefront(tile, finalWidth, finalHeight, firstSample, numOfSamples, g_wavefrontQueues[threadIndex]);
+	}
+	else if (g_tileTraversal == enPacketTraversal)
+	{
+		RenderTilePackets(tile, finalWidth, finalHeight, firstSample, numOfSamples);
+	}
+	else
+	{
+		RenderTile(tile, finalWidth, finalHeight, firstSample, numOfSamples);
+	}
+}
 
-	for (Vec3f& rPixel : downscaledPixels)
+// Averages the accumulated samples of the tile into g_finalPixels and copies the bright ones into g_bloomPixels
+void ResolveTile(const Tile& tile)
+{
+	for (int y = tile.m_y; y < tile.m_y + tile.m_height; y++)
 	{
-		rPixel.r /= gridSampleSize;
-		rPixel.g /= gridSampleSize;
-		rPixel.b /= gridSampleSize;
+		for (int x = tile.m_x; x < tile.m_x + tile.m_width; x++)
+		{
+			const int numOfSamples = std::max(1, g_pixelStatistics.At(x, y).m_numOfSamples);
+			Vec3f col = g_accumulatedPixels.At(x, y);
+			col.r /= static_cast<float>(numOfSamples);
+			col.g /= static_cast<float>(numOfSamples);
+			col.b /= static_cast<float>(numOfSamples);
+			g_finalPixels.At(x, y) = col;
+			g_bloomPixels.At(x, y) = col.magnitude() > 2.0f ? col : Vec3f(0.0f, 0.0f, 0.0f);
+		}
 	}
+}
+
+void ResolveAccumulatedPixels(ThreadPool& rThreadPool, const std::vector<Tile>& tiles)
+{
+	PROFILE_SCOPE("Resolve");
+	rThreadPool.Run(static_cast<int>(tiles.size()), [&](int tileIndex, int)
+	{
+		ResolveTile(tiles[tileIndex]);
+	});
+}
 
-	return downscaledPixels;
+std::vector<Tile> MakeTiles(int finalWidth, int finalHeight)
+{
+	std::vector<Tile> tiles;
+	for (int y = 0; y < finalHeight; y += TILE_SIZE)
+	{
+		for (int x = 0; x < finalWidth; x += TILE_SIZE)
+		{
+			Tile tile;
+			tile.m_x = x;
+			tile.m_y = y;
+			tile.m_width = std::min(TILE_SIZE, finalWidth - x);
+			tile.m_height = std::min(TILE_SIZE, finalHeight - y);
+			tiles.push_back(tile);
+		}
+	}
+	return tiles;
 }
 
-void Bloom(int width, int height)
+// Blooms, tone maps and writes the resolved image to fileName with .ppm, and .pfm if saving HDR, on the end
+void SaveFinalImage(int width, int height, ThreadPool& rThreadPool, const std::string& fileName = "RaytracedOutput")
 {
-	const int numOfWeights = 5;
-	const float weight[numOfWeights] = { 0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216 };
-	const int blurPixelWidth = 512;
-	const int blurPixelHeight = 512;
+	g_bloom.Apply(g_bloomPixels, rThreadPool);
+	g_toneMapper.Run<TONEMAP_OPERATOR>(g_finalPixels, g_bloomPixels, g_outputPixels, rThreadPool);
 
-	if (width < blurPixelWidth)
+	PROFILE_SCOPE("Save");
+	if (!WritePPM((fileName + ".ppm").c_str(), width, height, g_outputPixels))
 	{
-		g_bloomPixels = UpscaleImage(width, height, blurPixelWidth, blurPixelHeight, g_bloomPixels);
+		std::cout << "Failed to write " << fileName << ".ppm" << std::endl;
 	}
-	else
+	if (g_isSavingHdr)
 	{
-		g_bloomPixels = DownscaleImage(width, height, blurPixelWidth, blurPixelHeight, g_bloomPixels);
+		// The tone mapper left the image with bloom in g_finalPixels
+		std::vector<Vec3f> hdrPixels(width * height);
+		for (int y = 0; y < height; y++)
+		{
+			std::copy(g_finalPixels.GetRow(y), g_finalPixels.GetRow(y) + width, hdrPixels.begin() + width * y);
+		}
+		if (!WritePFM((fileName + ".pfm").c_str(), width, height, hdrPixels))
+		{
+			std::cout << "Failed to write " << fileName << ".pfm" << std::endl;
+		}
 	}
+}
+
+void MakeScene(const SphereFieldSettings& fieldSettings, int numOfFieldLights = 0)
+{
+	int numOfFieldSpheres = 0;
+	int numOfFieldLambertianDiffuses = 0;
+	int numOfFieldMetals = 0;
+	GetSphereFieldReserveCounts(fieldSettings, numOfFieldSpheres, numOfFieldLambertianDiffuses, numOfFieldMetals);
+	g_scene.Reserve(numOfFieldSpheres + 3, numOfFieldLights + 1, numOfFieldLambertianDiffuses + 1, numOfFieldMetals + 2, numOfFieldLights + 1);
+
+	g_scene.AddSphere(Vec3f(-4.0f, 1.0f, 0.0f), 1.0f, g_scene.AddMetal(Vec3f(0.7f, 0.6f, 0.5f), 0.0f));
+	g_scene.AddSphere(Vec3f(4.0f, 1.0f, 0.0f), 1.0f, g_scene.AddMetal(Vec3f(0.7f, 0.6f, 0.5f), 0.0f));
 
-	std::vector<Vec3f> g_bloomTempPixels = g_bloomPixels;
+	g_scene.AddLightSphere(Vec3f(0.0f, 1.65f, 0.0f), 0.5f, 30.0f, 0.8f, g_scene.AddEmmisive(Vec3f(0.969f, 0.906f, 0.039f), 2.0f));
+	GenerateLightField(g_scene, fieldSettings, numOfFieldLights);
 
-	// horizontal blur
-	for (int i = 0; i < g_bloomPixels.size(); i++)
+	const int numOfSpheresPlaced = GenerateSphereField(g_scene, fieldSettings);
+	if (numOfSpheresPlaced < fieldSettings.m_numOfSpheres)
 	{
-		Vec3f result = g_bloomPixels[i] * weight[0]; // current pixel contribution
-		for (int j = 1; j < numOfWeights; j++)
-		{
-			int index = i - j;
-			if (0 < index)
-			{
-				result += g_bloomPixels[index] * weight[j];
-			}
+		std::cout << "Only found room for " << numOfSpheresPlaced << " of " << fieldSettings.m_numOfSpheres << " spheres" << std::endl;
+	}
 
-			index = i + j;
-			if (index < g_bloomPixels.size())
-			{
-				result += g_bloomPixels[index] * weight[j];
-			}
-		}
-		g_bloomTempPixels[i] = result;
+	g_scene.AddSphere(Vec3f(0.0f, -1000.0f, 0.0f), 1000.0f, g_scene.AddLambertianDiffuse(Vec3f(0.5f, 0.5f, 0.5f)));
+}
+
+void SetupCamera(const CameraSettings& camera, int width, int height)
+{
+	g_camera.Setup(camera.m_lookFrom, camera.m_lookAt, camera.m_up, camera.m_verticalFov, static_cast<float>(width) / static_cast<float>(height), camera.m_aperture, camera.m_focusDistance);
+}
+
+// Builds the acceleration structures of g_scene and sizes everything a frame writes to
+void SetupRender(int width, int height)
+{
+	{
+		PROFILE_SCOPE("Build");
+		g_bvh.Build(g_scene.m_hitObjects);
+		g_lightSampler.Build(g_scene.m_lightObjects, g_scene.m_materials);
 	}
 
-	g_bloomPixels = g_bloomTempPixels;
+	SetupCamera(g_scene.m_camera, width, height);
+	g_sampleSequence.Setup(g_samplerType, g_antialisingSamples, g_renderSeed);
+
+	// Everything the tiles write to is allocated here, once, at its final size
+	g_finalPixels.Resize(width, height, Vec3f(0.0f, 0.0f, 0.0f));
+	g_bloomPixels.Resize(width, height, Vec3f(0.0f, 0.0f, 0.0f));
+	g_accumulatedPixels.Resize(width, height, Vec3f(0.0f, 0.0f, 0.0f));
+	g_pixelStatistics.Resize(width, height, PixelStatistics());
+	g_bloom.Setup(width, height);
+}
+
+void ClearAccumulatedPixels()
+{
+	g_accumulatedPixels.Fill(Vec3f(0.0f, 0.0f, 0.0f));
+	g_pixelStatistics.Fill(PixelStatistics());
+}
 
-	//vertical blur
-	for (int i = 0; i < g_bloomPixels.size(); i++)
+// Renders g_scene into g_accumulatedPixels, which have to be clear. Only touches g_finalPixels and g_bloomPixels
+// when saving progressive snapshots.
+void RenderSamples(ThreadPool& rThreadPool, const std::vector<Tile>& tiles, int width, int height)
+{
+	if (g_isProgressive)
 	{
-		Vec3f result = g_bloomPixels[i] * weight[0]; // current pixel contribution
-		for (int j = 1; j < numOfWeights; j++)
+		// One sample per pixel per pass, so there is always a complete image that can be saved
+		for (int pass = 0; pass < g_antialisingSamples; pass++)
 		{
-			int index = i - (j * blurPixelWidth);
-			if (0 < index)
 			{
-				result += g_bloomPixels[index] * weight[j];
+				PROFILE_SCOPE_INDEX("Render", pass);
+				rThreadPool.Run(static_cast<int>(tiles.size()), [&](int tileIndex, int threadIndex)
+				{
+					PROFILE_SCOPE_INDEX("Tile", tileIndex);
+					RenderTileSamples(tiles[tileIndex], width, height, pass, 1, threadIndex);
+				});
 			}
 
-			index = i + (j * blurPixelWidth);
-			if (index < g_bloomPixels.size())
+			const bool isLastPass = (pass == g_antialisingSamples - 1);
+			if (!isLastPass && g_snapshotInterval > 0 && (pass + 1) % g_snapshotInterval == 0)
 			{
-				result += g_bloomPixels[index] * weight[j];
+				ResolveAccumulatedPixels(rThreadPool, tiles);
+				SaveFinalImage(width, height, rThreadPool);
+				std::cout << "Saved snapshot at " << pass + 1 << " samples per pixel" << std::endl;
 			}
 		}
-		g_bloomTempPixels[i] = result;
 	}
+	else
+	{
+		PROFILE_SCOPE("Render");
+		rThreadPool.Run(static_cast<int>(tiles.size()), [&](int tileIndex, int threadIndex)
+		{
+			PROFILE_SCOPE_INDEX("Tile", tileIndex);
+			RenderTileSamples(tiles[tileIndex], width, height, 0, g_antialisingSamples, threadIndex);
+		});
+	}
+}
+
+// Renders g_scene and resolves it into g_finalPixels and g_bloomPixels, ready for SaveFinalImage
+void RenderFrame(ThreadPool& rThreadPool, const std::vector<Tile>& tiles, int width, int height)
+{
+	RenderSamples(rThreadPool, tiles, width, height);
+	ResolveAccumulatedPixels(rThreadPool, tiles);
+}
 
-	g_bloomPixels = g_bloomTempPixels;
+// Renders numOfFrames frames along the camera path, written as RaytracedOutput_0000.ppm onwards. The scene, BVH,
+// thread pool and framebuffers are all kept from one frame to the next. Saving a frame only reads g_finalPixels and
+// g_bloomPixels while rendering only writes the accumulated pixels, so frame N is bloomed, tone mapped and written
+// on a thread of its own while frame N + 1 renders, and only the resolve has to wait for it.
+void RenderAnimation(ThreadPool& rThreadPool, const std::vector<Tile>& tiles, int width, int height, const CameraPath& cameraPath, int numOfFrames)
+{
+	// Post processing is light next to rendering, so one thread of its own is enough
+	ThreadPool postThreadPool(1);
+	std::thread postThread;
+	const uint64_t baseSeed = g_renderSeed;
 
-	if (width < blurPixelWidth)
+	for (int frame = 0; frame < numOfFrames; frame++)
 	{
-		g_bloomPixels = DownscaleImage(blurPixelWidth, blurPixelHeight, width, height, g_bloomPixels);
+		auto frameStart = std::chrono::high_resolution_clock::now();
+
+		const float time = numOfFrames > 1 ? cameraPath.GetDuration() * frame / (numOfFrames - 1) : 0.0f;
+		SetupCamera(cameraPath.Evaluate(cameraPath.GetStartTime() + time), width, height);
+		// Otherwise every frame has the same noise. The sequence keeps its own copy of the seed for the blue noise
+		// sampler's points, the blue noise texture itself is kept.
+		g_renderSeed = HashSeed(baseSeed, frame);
+		g_sampleSequence.Setup(g_samplerType, g_antialisingSamples, g_renderSeed);
+		ClearAccumulatedPixels();
+		RenderSamples(rThreadPool, tiles, width, height);
+
+		if (postThread.joinable())
+		{
+			postThread.join();
+		}
+		ResolveAccumulatedPixels(rThreadPool, tiles);
+
+		char fileName[64];
+		snprintf(fileName, sizeof(fileName), "RaytracedOutput_%04d", frame);
+		const std::string frameFileName = fileName;
+		postThread = std::thread([&postThreadPool, width, height, frameFileName]()
+		{
+			SaveFinalImage(width, height, postThreadPool, frameFileName);
+		});
+
+		auto frameEnd = std::chrono::high_resolution_clock::now();
+		std::cout << "Rendered frame " << frame + 1 << " of " << numOfFrames << " in " << std::chrono::duration<double, std::milli>(frameEnd - frameStart).count() << " ms" << std::endl;
 	}
-	else
+
+	if (postThread.joinable())
 	{
-		g_bloomPixels = UpscaleImage(blurPixelWidth, blurPixelHeight, width, height, g_bloomPixels);
+		postThread.join();
 	}
+	g_renderSeed = baseSeed;
+	g_sampleSequence.Setup(g_samplerType, g_antialisingSamples, g_renderSeed);
 }
 
-void SaveFinalImage(int width, int height)
+// A fixed scene for the benchmarks. Everything about it comes from the layout of MakeScene and a fixed seed, so
+// every run renders exactly the same image.
+struct BenchmarkScene
+{
+	const char* m_name;
+	int m_numOfSpheres;
+	int m_numOfFieldLights;
+	float m_metalChance;
+	bool m_isRenderBenchmark;	// Rendered by -benchmark
+	bool m_isTraversalBenchmark;	// Rendered by -benchmarktraversal, which is about sphere fields of growing size
+};
+
+const BenchmarkScene g_benchmarkScenes[] =
+{
+	{ "default", 100, 0, 0.25f, true, true },
+	{ "field100k", 100000, 0, 0.25f, true, true },
+	{ "field1m", 1000000, 0, 0.25f, false, true },
+	{ "manylights", 100, 64, 0.25f, true, false },
+	{ "metal", 400, 0, 1.0f, true, false },
+};
+
+// Replaces g_scene with the benchmark scene, SetupRender still has to be called for it
+void MakeBenchmarkScene(const BenchmarkScene& benchmarkScene)
 {
-	std::ofstream myfile;
-	myfile.open("RaytracedOutput.ppm");
-	myfile.clear();
+	SphereFieldSettings fieldSettings;
+	fieldSettings.m_center = Vec3f(-0.55f, 0.0f, 0.95f);
+	fieldSettings.m_numOfSpheres = benchmarkScene.m_numOfSpheres;
+	fieldSettings.m_metalChance = benchmarkScene.m_metalChance;
 
-	myfile << "P3\n" << width << " " << height << "\n255\n";
+	g_scene.Clear();
+	MakeScene(fieldSettings, benchmarkScene.m_numOfFieldLights);
+}
 
-	for(int i = 0; i < g_finalPixels.size(); i++)
-	{
-		Vec3f hdrColour = g_finalPixels[i];
-		hdrColour += g_bloomPixels[i];
-		//Vec3f hdrColour = g_bloomPixels[i];
-		Vec3f col = ACESFilmToneMapper(hdrColour);
-		int r = static_cast<int>(255.0f * col.r);
-		int g = static_cast<int>(255.0f * col.g);
-		int b = static_cast<int>(255.0f * col.b);
+// Only the options that change how a frame is traced are left to the command line
+void ResetBenchmarkOptions()
+{
+	g_renderSeed = 0;
+	g_antialisingSamples = BENCHMARK_SAMPLES;
+	g_isProgressive = false;
+	g_isAdaptive = false;
+}
 
-		myfile << r << " " << g << " " << b << "\n";
+// Opens a benchmark's JSON file and writes the settings every benchmark runs with, up to the start of its results
+FILE* OpenBenchmarkJson(const char* fileName)
+{
+	FILE* pFile = fopen(fileName, "w");
+	if (pFile == nullptr)
+	{
+		std::cout << "Failed to open " << fileName << " for writing" << std::endl;
+		return nullptr;
 	}
-	myfile.close();
+	fprintf(pFile, "{\n\t\"width\": %d,\n\t\"height\": %d,\n\t\"samplesPerPixel\": %d,\n\t\"maxDepth\": %d,\n\t\"shadowRays\": %d,\n\t\"sampler\": \"%s\",\n\t\"wavefront\": %s,\n\t\"repeats\": %d,\n\t\"results\": [\n",
+		BENCHMARK_WIDTH, BENCHMARK_HEIGHT, g_antialisingSamples, g_maxRayDepth, g_numOfShadowRays, g_samplerTypeNames[g_samplerType], g_isWavefront ? "true" : "false", BENCHMARK_REPEATS);
+	return pFile;
 }
 
-bool CanSpawnSphere(Vec3f position, float radius)
+void CloseBenchmarkJson(FILE* pFile, const char* fileName)
 {
-	bool canSpawn = true;
-	for (HitObject* pHitObject : g_hitObjectsList)
+	fprintf(pFile, "\n\t]\n}\n");
+	fclose(pFile);
+	std::cout << "Wrote " << fileName << std::endl;
+}
+
+// Every ray traced, counted by the profiler, so it reads 0 with PROFILING turned off
+uint64_t GetNumOfRays(const uint64_t (&counters)[enNumOfProfileCounters])
+{
+	return counters[enPrimaryRays] + counters[enBounceRays] + counters[enShadowRays];
+}
+
+// Renders each benchmark scene with 1, 2, 4... threads up to the hardware thread count, and writes the time per
+// frame, rays per second and time of each stage to Benchmark.json
+void RunRenderBenchmark()
+{
+	const char* stageNames[] = { "Render", "Resolve", "Bloom", "Tone map" };
+
+	const int maxNumOfThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	std::vector<int> threadCounts;
+	for (int numOfThreads = 1; numOfThreads < maxNumOfThreads; numOfThreads *= 2)
+	{
+		threadCounts.push_back(numOfThreads);
+	}
+	threadCounts.push_back(maxNumOfThreads);
+
+	ResetBenchmarkOptions();
+	GetProfiler().SetRecordingEvents(true); // The stage times are read back from the events
+
+	FILE* pFile = OpenBenchmarkJson("Benchmark.json");
+	if (pFile == nullptr)
+	{
+		return;
+	}
+
+	std::cout << "scene, threads, ms/frame, Mrays/s, render ms, resolve ms, bloom ms, tone map ms" << std::endl;
+
+	bool isFirstResult = true;
+	for (const BenchmarkScene& benchmarkScene : g_benchmarkScenes)
 	{
-		float distance = (pHitObject->m_position - position).magnitude();
-		if (distance <= static_cast<Sphere*>(pHitObject)->m_radius + radius)
+		if (!benchmarkScene.m_isRenderBenchmark)
+		{
+			continue;
+		}
+		MakeBenchmarkScene(benchmarkScene);
+
+		auto setupStart = std::chrono::high_resolution_clock::now();
+		SetupRender(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+		auto setupEnd = std::chrono::high_resolution_clock::now();
+		const double setupMs = std::chrono::duration<double, std::milli>(setupEnd - setupStart).count();
+		const std::vector<Tile> tiles = MakeTiles(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+
+		for (int numOfThreads : threadCounts)
 		{
-			canSpawn = false;
-			break;
+			ThreadPool threadPool(numOfThreads);
+			g_wavefrontQueues.resize(numOfThreads);
+
+			double bestFrameMs = 0.0;
+			uint64_t counters[enNumOfProfileCounters] = {};
+			std::map<std::string, double> stageTotals;
+			for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+			{
+				ClearAccumulatedPixels();
+				GetProfiler().Reset();
+
+				auto frameStart = std::chrono::high_resolution_clock::now();
+				RenderFrame(threadPool, tiles, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+				g_bloom.Apply(g_bloomPixels, threadPool);
+				g_toneMapper.Run<TONEMAP_OPERATOR>(g_finalPixels, g_bloomPixels, g_outputPixels, threadPool);
+				auto frameEnd = std::chrono::high_resolution_clock::now();
+				const double frameMs = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+
+				if (repeat == 0 || frameMs < bestFrameMs)
+				{
+					bestFrameMs = frameMs;
+					GetProfiler().GetCounters(counters);
+					std::map<std::string, int> stageCounts;
+					stageTotals.clear();
+					GetProfiler().GetEventTotals(stageTotals, stageCounts);
+				}
+			}
+
+			const uint64_t numOfRays = GetNumOfRays(counters);
+			const double renderMs = stageTotals["Render"];
+			const double mraysPerSecond = renderMs > 0.0 ? numOfRays / (renderMs * 1000.0) : 0.0;
+
+			std::cout << benchmarkScene.m_name << ", " << numOfThreads << ", " << bestFrameMs << ", " << mraysPerSecond;
+			fprintf(pFile, "%s\t\t{ \"scene\": \"%s\", \"spheres\": %d, \"lights\": %d, \"threads\": %d, \"setupMs\": %.3f, \"msPerFrame\": %.3f, \"mraysPerSecond\": %.4f, \"rays\": %llu, \"samples\": %llu, \"stageMs\": { ",
+				isFirstResult ? "" : ",\n", benchmarkScene.m_name, static_cast<int>(g_scene.m_hitObjects.size()), static_cast<int>(g_scene.m_lightObjects.size()), numOfThreads, setupMs,
+				bestFrameMs, mraysPerSecond, static_cast<unsigned long long>(numOfRays), static_cast<unsigned long long>(counters[enSamples]));
+			for (size_t stage = 0; stage < sizeof(stageNames) / sizeof(stageNames[0]); stage++)
+			{
+				std::cout << ", " << stageTotals[stageNames[stage]];
+				fprintf(pFile, "%s\"%s\": %.3f", stage == 0 ? "" : ", ", stageNames[stage], stageTotals[stageNames[stage]]);
+			}
+			std::cout << std::endl;
+			fprintf(pFile, " } }");
+			isFirstResult = false;
 		}
 	}
-	return canSpawn;
+
+	CloseBenchmarkJson(pFile, "Benchmark.json");
 }
 
-void MakeScene()
+// Renders the sphere field scenes with each tile traversal on the calling thread, so the cache counters see all of
+// the work, and writes the time per frame, rays per second and cache misses to TraversalBenchmark.json. Every
+// traversal renders the same image.
+bool RunTraversalBenchmark()
 {
-	g_hitObjectsList.push_back(new Sphere(Vec3f(-4.0f, 1.0f, 0.0f), 1.0f, new Metal(Vec3f(0.7f, 0.6f, 0.5f), 0.0f)));
-	g_hitObjectsList.push_back(new Sphere(Vec3f(4.0f, 1.0f, 0.0f), 1.0f, new Metal(Vec3f(0.7f, 0.6f, 0.5f), 0.0f)));
+	ResetBenchmarkOptions();
+	g_wavefrontQueues.resize(1);
+
+	CacheCounters cacheCounters;
+	for (int counter = 0; counter < enNumOfCacheCounters; counter++)
+	{
+		if (!cacheCounters.IsAvailable(static_cast<CacheCounter>(counter)))
+		{
+			std::cout << "The " << g_cacheCounterNames[counter] << " counter is unavailable and reads 0" << std::endl;
+		}
+	}
 
-	LightSphere* pLightObject0 = new LightSphere(Vec3f(0.0f, 1.65f, 0.0f), 0.5f, 30.0f, 0.8f, new Emmisive(Vec3f(0.969f, 0.906f, 0.039f), 2.0f));
-	g_hitObjectsList.push_back(pLightObject0);
-	g_lightObjectsList.push_back(pLightObject0);
+	FILE* pFile = OpenBenchmarkJson("TraversalBenchmark.json");
+	if (pFile == nullptr)
+	{
+		return false;
+	}
+
+	std::cout << "scene, traversal, ms/frame, Mrays/s, " << g_cacheCounterNames[enL1DataReadMisses] << "/ray, " << g_cacheCounterNames[enLastLevelCacheMisses] << "/ray" << std::endl;
 
-	const int numOfRandomSpheres = 100;
-	for (int i = 0; i < numOfRandomSpheres; i++)
+	const TileTraversal initialTraversal = g_tileTraversal;
+	bool isFirstResult = true;
+	for (const BenchmarkScene& benchmarkScene : g_benchmarkScenes)
 	{
-		bool isSpawned = false;
-		while (!isSpawned)
+		if (!benchmarkScene.m_isTraversalBenchmark)
 		{
-			float radius = GetRandomNum() * 0.2f + 0.2f;
-			Vec3f center((rand() % 20 - 11) + 0.9f * GetRandomNum(), radius, (rand() % 17 - 8) + 0.9f * GetRandomNum());
-			if (CanSpawnSphere(center, radius))
+			continue;
+		}
+		MakeBenchmarkScene(benchmarkScene);
+		SetupRender(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+		const std::vector<Tile> tiles = MakeTiles(BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+
+		// The repeats go round all the traversals in turn, so a machine that speeds up or slows down during the
+		// benchmark doesn't favour whichever traversal runs first
+		double bestFrameMs[enNumOfTileTraversals] = {};
+		uint64_t counters[enNumOfTileTraversals][enNumOfProfileCounters] = {};
+		uint64_t cacheMisses[enNumOfTileTraversals][enNumOfCacheCounters] = {};
+		for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+		{
+			for (int traversal = 0; traversal < enNumOfTileTraversals; traversal++)
 			{
-				isSpawned = true;
-				float chooseMaterial = GetRandomNum();
-				if (chooseMaterial <= 0.75f)
+				g_tileTraversal = static_cast<TileTraversal>(traversal);
+				ClearAccumulatedPixels();
+				GetProfiler().Reset();
+
+				auto frameStart = std::chrono::high_resolution_clock::now();
+				cacheCounters.Start();
+				for (const Tile& tile : tiles)
 				{
-					Vec3f colour;
-					while (colour.magnitude() < 0.1f) // Make sure the random colour isn't too dark
+					RenderTileSamples(tile, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, 0, g_antialisingSamples, 0);
+				}
+				cacheCounters.Stop();
+				auto frameEnd = std::chrono::high_resolution_clock::now();
+				const double frameMs = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+
+				if (repeat == 0 || frameMs < bestFrameMs[traversal])
+				{
+					bestFrameMs[traversal] = frameMs;
+					GetProfiler().GetCounters(counters[traversal]);
+					for (int counter = 0; counter < enNumOfCacheCounters; counter++)
 					{
-						colour = Vec3f(GetRandomNum() * GetRandomNum(), GetRandomNum() * GetRandomNum(), GetRandomNum() * GetRandomNum());
+						cacheMisses[traversal][counter] = cacheCounters.GetCount(static_cast<CacheCounter>(counter));
 					}
-					g_hitObjectsList.push_back(new Sphere(center, radius, new LambertianDiffuse(colour)));
+				}
+			}
+		}
+
+		for (int traversal = 0; traversal < enNumOfTileTraversals; traversal++)
+		{
+			const uint64_t numOfRays = GetNumOfRays(counters[traversal]);
+			const double mraysPerSecond = bestFrameMs[traversal] > 0.0 ? numOfRays / (bestFrameMs[traversal] * 1000.0) : 0.0;
+			const double raysDivisor = static_cast<double>(std::max<uint64_t>(1, numOfRays));
+
+			std::cout << benchmarkScene.m_name << ", " << g_tileTraversalNames[traversal] << ", " << bestFrameMs[traversal] << ", " << mraysPerSecond << ", "
+				<< cacheMisses[traversal][enL1DataReadMisses] / raysDivisor << ", " << cacheMisses[traversal][enLastLevelCacheMisses] / raysDivisor << std::endl;
+			fprintf(pFile, "%s\t\t{ \"scene\": \"%s\", \"spheres\": %d, \"traversal\": \"%s\", \"msPerFrame\": %.3f, \"mraysPerSecond\": %.4f, \"rays\": %llu",
+				isFirstResult ? "" : ",\n", benchmarkScene.m_name, static_cast<int>(g_scene.m_hitObjects.size()), g_tileTraversalNames[traversal], bestFrameMs[traversal], mraysPerSecond,
+				static_cast<unsigned long long>(numOfRays));
+			for (int counter = 0; counter < enNumOfCacheCounters; counter++)
+			{
+				// null rather than 0 when the counter couldn't be read, so it isn't taken for a perfect score
+				if (cacheCounters.IsAvailable(static_cast<CacheCounter>(counter)))
+				{
+					fprintf(pFile, ", \"%s\": %llu", g_cacheCounterNames[counter], static_cast<unsigned long long>(cacheMisses[traversal][counter]));
 				}
 				else
 				{
-					g_hitObjectsList.push_back(new Sphere(center, radius, new Metal(Vec3f(0.5f * (1.0f + GetRandomNum()), 0.5f * (1.0f + GetRandomNum()), 0.5f * (1.0f + GetRandomNum())), 0.5f * GetRandomNum())));
+					fprintf(pFile, ", \"%s\": null", g_cacheCounterNames[counter]);
 				}
 			}
+			fprintf(pFile, " }");
+			isFirstResult = false;
 		}
 	}
+	g_tileTraversal = initialTraversal;
 
-	g_hitObjectsList.push_back(new Sphere(Vec3f(0.0f, -1000.0f, 0.0f), 1000.0f, new LambertianDiffuse(Vec3f(0.5f, 0.5f, 0.5f))));
+	CloseBenchmarkJson(pFile, "TraversalBenchmark.json");
+	return true;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-	const int outputImageWidth = 1920;
-	const int outputImageHeight = 1080;
+	const char* sceneFileName = nullptr;
+	const char* saveSceneFileName = nullptr;
+	bool isBenchmarking = false;
+	bool isBenchmarkingTraversal = false;
 
-	MakeScene();
+	// Same area as the original hand placed field of 100 spheres
+	SphereFieldSettings fieldSettings;
+	fieldSettings.m_center = Vec3f(-0.55f, 0.0f, 0.95f);
 
-	Vec3f lookfrom(13.0f, 2.0f, 3.0f);
-	Vec3f lookat(0.0f, 0.0f, 0.0f);
-	float distanceToFocus = 10.0f;
-	float aperture = 0.1f;
-	g_camera.Setup(lookfrom, lookat, Vec3f(0.0f, 1.0f, 0.0f), 20.0f, static_cast<float>(outputImageWidth) / static_cast<float>(outputImageHeight), aperture, distanceToFocus);
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-benchmarkbvh") == 0)
+		{
+			RunBVHBenchmark();
+			return 0;
+		}
+		else if (strcmp(argv[i], "-checkfastmath") == 0)
+		{
+			return RunFastMathCheck() ? 0 : 1;
+		}
+		else if (strcmp(argv[i], "-benchmarksampling") == 0)
+		{
+			return RunSamplingBenchmark() ? 0 : 1;
+		}
+		else if (strcmp(argv[i], "-benchmarkvec") == 0)
+		{
+			RunVectorBenchmark();
+			return 0;
+		}
+		else if (strcmp(argv[i], "-benchmark") == 0)
+		{
+			isBenchmarking = true;
+		}
+		else if (strcmp(argv[i], "-benchmarktraversal") == 0)
+		{
+			isBenchmarkingTraversal = true;
+		}
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+		{
+			g_renderSeed = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "-maxdepth") == 0 && i + 1 < argc)
+		{
+			g_maxRayDepth = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-spp") == 0 && i + 1 < argc)
+		{
+			g_antialisingSamples = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-shadowrays") == 0 && i + 1 < argc)
+		{
+			g_numOfShadowRays = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-wavefront") == 0)
+		{
+			g_isWavefront = true;
+		}
+		else if (strcmp(argv[i], "-progressive") == 0)
+		{
+			g_isProgressive = true;
+		}
+		else if (strcmp(argv[i], "-snapshot") == 0 && i + 1 < argc)
+		{
+			g_snapshotInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-adaptive") == 0 && i + 1 < argc)
+		{
+			g_isAdaptive = true;
+			g_adaptiveThreshold = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-scene") == 0 && i + 1 < argc)
+		{
+			sceneFileName = argv[++i];
+		}
+		else if (strcmp(argv[i], "-savescene") == 0 && i + 1 < argc)
+		{
+			saveSceneFileName = argv[++i];
+		}
+		else if (strcmp(argv[i], "-spheres") == 0 && i + 1 < argc)
+		{
+			fieldSettings.m_numOfSpheres = atoi(argv[++i]);
+			if (fieldSettings.m_numOfSpheres < 0)
+			{
+				std::cout << "Invalid sphere count " << argv[i] << ", expected 0 or more" << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-density") == 0 && i + 1 < argc)
+		{
+			fieldSettings.m_density = static_cast<float>(atof(argv[++i]));
+			if (!(fieldSettings.m_density > 0.0f) || !isfinite(fieldSettings.m_density))
+			{
+				std::cout << "Invalid density " << argv[i] << ", expected a number above 0" << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-exposure") == 0 && i + 1 < argc)
+		{
+			g_toneMapper.SetExposure(static_cast<float>(atof(argv[++i])));
+		}
+		else if (strcmp(argv[i], "-hdr") == 0)
+		{
+			g_isSavingHdr = true;
+		}
+		else if (strcmp(argv[i], "-animate") == 0 && i + 1 < argc)
+		{
+			g_numOfAnimationFrames = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-orbit") == 0 && i + 1 < argc)
+		{
+			g_animationOrbitDegrees = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-profile") == 0)
+		{
+			g_isProfiling = true;
+		}
+		else if (strcmp(argv[i], "-minspp") == 0 && i + 1 < argc)
+		{
+			g_minAdaptiveSamples = std::max(2, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-sampler") == 0 && i + 1 < argc)
+		{
+			const char* pSamplerName = argv[++i];
+			int type = 0;
+			while (type < enNumOfSamplerTypes && strcmp(pSamplerName, g_samplerTypeNames[type]) != 0)
+			{
+				type++;
+			}
+			if (type == enNumOfSamplerTypes)
+			{
+				std::cout << "Unknown sampler " << pSamplerName << ", expected random, stratified, halton, sobol or bluenoise" << std::endl;
+				return 1;
+			}
+			g_samplerType = static_cast<SamplerType>(type);
+		}
+		else if (strcmp(argv[i], "-traversal") == 0 && i + 1 < argc)
+		{
+			const char* pTraversalName = argv[++i];
+			int traversal = 0;
+			while (traversal < enNumOfTileTraversals && strcmp(pTraversalName, g_tileTraversalNames[traversal]) != 0)
+			{
+				traversal++;
+			}
+			if (traversal == enNumOfTileTraversals)
+			{
+				std::cout << "Unknown traversal " << pTraversalName << ", expected scanline, morton or packets" << std::endl;
+				return 1;
+			}
+			g_tileTraversal = static_cast<TileTraversal>(traversal);
+		}
+	}
 
-	srand(time(0));
+	GetProfiler().SetRecordingEvents(g_isProfiling);
 
-#ifdef USETHREADS
-	const int imageSectionRows = static_cast<int>(sqrtf(PROCESSOR_NUM));
-	const int imageSectionColumns = PROCESSOR_NUM / imageSectionRows;
+	if (isBenchmarking)
+	{
+		RunRenderBenchmark();
+		return 0;
+	}
 
-	const int imageSectionWidth = outputImageWidth / imageSectionColumns;
-	const int imageSectionHeight = outputImageHeight / imageSectionRows;
+	if (isBenchmarkingTraversal)
+	{
+		return RunTraversalBenchmark() ? 0 : 1;
+	}
 
-	std::vector<std::thread*> threads;
+	const int outputImageWidth = 1920;
+	const int outputImageHeight = 1080;
 
-	for (int y = 0; y < imageSectionRows; y++)
+	if (sceneFileName != nullptr)
 	{
-		for (int x = 0; x < imageSectionColumns; x++)
+		if (!LoadScene(sceneFileName, g_scene))
 		{
-			int bottomLeftPixelX = imageSectionWidth * x;
-			int bottomLeftPixelY = imageSectionHeight - (imageSectionHeight * y);
-			std::thread* pThread = new std::thread(CreateImageSection, bottomLeftPixelX, bottomLeftPixelY, imageSectionWidth, imageSectionHeight, outputImageWidth, outputImageHeight, x + (imageSectionColumns * y));
-			threads.push_back(pThread);
+			return 1;
 		}
 	}
-
-	for (std::thread* pThread : threads)
+	else
 	{
-		pThread->join();
+		MakeScene(fieldSettings);
 	}
 
-	for (std::thread* pThread : threads)
+	if (saveSceneFileName != nullptr)
 	{
-		delete pThread;
+		SaveScene(saveSceneFileName, g_scene);
 	}
 
-	CreateFinalImage(imageSectionWidth, imageSectionHeight, outputImageWidth, outputImageHeight, imageSectionRows, imageSectionColumns);
+	SetupRender(outputImageWidth, outputImageHeight);
+	const std::vector<Tile> tiles = MakeTiles(outputImageWidth, outputImageHeight);
+
+#ifdef USETHREADS
+	ThreadPool threadPool;
 #else
-	CreateImageSection(0, 0, outputImageWidth, outputImageHeight, outputImageWidth, outputImageHeight, 0);
-	CreateFinalImage(outputImageWidth, outputImageHeight, outputImageWidth, outputImageHeight, 1, 1);
+	ThreadPool threadPool(1);
 #endif // USETHREADS
+	g_wavefrontQueues.resize(threadPool.GetNumOfThreads());
+
+	if (g_numOfAnimationFrames > 0)
+	{
+		// A snapshot would write the resolved image while the last frame is still being saved from it
+		g_snapshotInterval = 0;
 
-	Bloom(outputImageWidth, outputImageHeight);
+		CameraPath cameraPath;
+		MakeOrbitPath(g_scene.m_camera, g_animationOrbitDegrees, static_cast<float>(g_numOfAnimationFrames), cameraPath);
+		RenderAnimation(threadPool, tiles, outputImageWidth, outputImageHeight, cameraPath, g_numOfAnimationFrames);
+	}
+	else
+	{
+		RenderFrame(threadPool, tiles, outputImageWidth, outputImageHeight);
+
+		if (g_isAdaptive)
+		{
+			double totalSamples = 0.0;
+			for (int y = 0; y < outputImageHeight; y++)
+			{
+				for (int x = 0; x < outputImageWidth; x++)
+				{
+					totalSamples += g_pixelStatistics.At(x, y).m_numOfSamples;
+				}
+			}
+			std::cout << "Average samples per pixel: " << totalSamples / (outputImageWidth * outputImageHeight) << std::endl;
+		}
 
-	SaveFinalImage(outputImageWidth, outputImageHeight);
+		SaveFinalImage(outputImageWidth, outputImageHeight, threadPool);
+	}
 
-	for (HitObject* pHitObject : g_hitObjectsList)
+	if (g_isProfiling)
 	{
-		delete pHitObject;
+		GetProfiler().WriteJson("Profile.json");
+		GetProfiler().WriteChromeTrace("ProfileTrace.json");
 	}
 
 	return 0;
 }
-